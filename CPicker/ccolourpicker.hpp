@@ -15,7 +15,11 @@ dllimport
 ) CColourPicker {
 
 public:
-	constexpr CColourPicker(uint32_t &value, HWND hParentWindow = NULL) : Value(value), CurrCol(), OldCol(), hParent(hParentWindow)
+	// Called with the new value every time the colour changes, from the thread running the picker.
+	using ChangeCallback = void (*)(uint32_t value, void *context);
+
+	constexpr CColourPicker(uint32_t &value, HWND hParentWindow = NULL, ChangeCallback callback = nullptr, void *context = nullptr) :
+		Value(value), CurrCol(), OldCol(), hParent(hParentWindow), Callback(callback), Context(context)
 	{
 		CurrCol.r = (Value & 0x00FF0000) >> 16;
 		CurrCol.g = (Value & 0x0000FF00) >> 8;
@@ -74,10 +78,16 @@ private:
 	constexpr void UpdateValue()
 	{
 		Value = (CurrCol.a << 24) + (CurrCol.r << 16) + (CurrCol.g << 8) + CurrCol.b;
+		if (Callback)
+		{
+			Callback(Value, Context);
+		}
 	}
 
 	uint32_t &Value;
 	// The current selected colour and the previous selected one
 	SColour CurrCol, OldCol;
 	HWND hParent;
+	ChangeCallback Callback;
+	void *Context;
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+// Standard API
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <io.h>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Local stuff
+#include "../TranslucentTB/binarylog.hpp"
+#include "../TranslucentTB/errorformat.hpp"
+
+int wmain(int argc, wchar_t *argv[])
+{
+	if (argc != 2 && argc != 3)
+	{
+		std::fputws(L"Usage: LogDecoder <binary log> [text log]\nWithout a text log, the log is printed.\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	std::ifstream input(argv[1], std::ios::binary);
+	if (!input)
+	{
+		std::fputws(L"Failed to open binary log.\n", stderr);
+		return EXIT_FAILURE;
+	}
+	const std::vector<uint8_t> data((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+	std::wstring text;
+	const bool complete = BinaryLog::Decode(data.data(), data.size(), text, ErrorFormat::FromHRESULT);
+	if (argc == 3)
+	{
+		text.insert(text.begin(), L'\uFEFF');
+		std::ofstream output(argv[2], std::ios::binary | std::ios::trunc);
+		if (!output.write(reinterpret_cast<const char *>(text.data()), text.length() * sizeof(wchar_t)))
+		{
+			std::fputws(L"Failed to write text log.\n", stderr);
+			return EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		// The console translates line endings itself.
+		text.erase(std::remove(text.begin(), text.end(), L'\r'), text.end());
+		_setmode(_fileno(stdout), _O_U16TEXT);
+		std::fputws(text.c_str(), stdout);
+	}
+
+	if (!complete)
+	{
+		std::fputws(L"Not a binary log, or it is corrupted. Everything before the corruption was decoded.\n", stderr);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
\ No newline at end of file
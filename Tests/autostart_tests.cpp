@@ -0,0 +1,175 @@
+// Standard API
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Windows API
+#include "../TranslucentTB/arch.h"
+#include <synchapi.h>
+#include <windef.h>
+#include <winerror.h>
+
+// Local stuff
+#include "../TranslucentTB/autostart.hpp"
+#include "../TranslucentTB/common.hpp"
+#include "test.hpp"
+
+static constexpr const wchar_t *RUN_KEY = LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Run)";
+static constexpr const wchar_t *APPROVED_KEY = LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Explorer\StartupApproved\Run)";
+
+// Keeps the values in memory and counts what the cache asks of it. Changes made through the
+// interface don't notify, so that the tests can tell which of the two dropped the cached state.
+class FakeRegistry : public Autostart::Registry {
+
+private:
+	void Notify(const wchar_t *key)
+	{
+		if (const auto it = watchers.find(key); it != watchers.end())
+		{
+			SetEvent(it->second);
+			watchers.erase(it);
+		}
+	}
+
+public:
+	std::map<std::pair<std::wstring, std::wstring>, std::vector<uint8_t>> values;
+	std::map<std::wstring, HANDLE> watchers;
+	std::map<std::wstring, unsigned int> watch_calls;
+	unsigned int reads = 0;
+
+	// Like another program editing the key.
+	void Change(const wchar_t *key, const wchar_t *value, std::vector<uint8_t> data)
+	{
+		values[{ key, value }] = std::move(data);
+		Notify(key);
+	}
+
+	void Remove(const wchar_t *key, const wchar_t *value)
+	{
+		values.erase({ key, value });
+		Notify(key);
+	}
+
+	LSTATUS GetValue(const wchar_t *key, const wchar_t *value, DWORD, void *data, DWORD *size) override
+	{
+		reads++;
+		const auto it = values.find({ key, value });
+		if (it == values.end())
+		{
+			return ERROR_FILE_NOT_FOUND;
+		}
+
+		if (size)
+		{
+			const DWORD available = *size;
+			*size = static_cast<DWORD>(it->second.size());
+			if (data)
+			{
+				if (available < it->second.size())
+				{
+					return ERROR_MORE_DATA;
+				}
+
+				std::copy(it->second.begin(), it->second.end(), static_cast<uint8_t *>(data));
+			}
+		}
+
+		return ERROR_SUCCESS;
+	}
+
+	LSTATUS SetString(const wchar_t *key, const wchar_t *value, std::wstring_view data) override
+	{
+		const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+		values[{ key, value }].assign(bytes, bytes + data.length() * sizeof(wchar_t));
+		return ERROR_SUCCESS;
+	}
+
+	LSTATUS DeleteValue(const wchar_t *key, const wchar_t *value) override
+	{
+		return values.erase({ key, value }) != 0 ? ERROR_SUCCESS : ERROR_FILE_NOT_FOUND;
+	}
+
+	LSTATUS NotifyChange(const wchar_t *key, HANDLE event) override
+	{
+		watch_calls[key]++;
+		watchers[key] = event;
+		return ERROR_SUCCESS;
+	}
+};
+
+// Starts with TranslucentTB set to run at startup. The cache owns the fake, until the next call.
+static FakeRegistry &InstallFakeRegistry()
+{
+	auto fake = std::make_unique<FakeRegistry>();
+	FakeRegistry &registry = *fake;
+	registry.values[{ RUN_KEY, NAME }] = { '"', 0, '"', 0 };
+	Autostart::SetRegistry(std::move(fake));
+	return registry;
+}
+
+// The first byte is what Task Manager changes, 2 is enabled and 3 disabled.
+static std::vector<uint8_t> ApprovedStatus(const uint8_t &status)
+{
+	std::vector<uint8_t> value(12);
+	value[0] = status;
+	return value;
+}
+
+TEST(StartupStateCacheHit)
+{
+	FakeRegistry &registry = InstallFakeRegistry();
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Enabled);
+
+	const unsigned int reads = registry.reads;
+	for (int i = 0; i < 3; i++)
+	{
+		CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Enabled);
+	}
+	CHECK(registry.reads == reads);
+
+	// Watching a key again before its notification fired would pile them up.
+	CHECK(registry.watch_calls[RUN_KEY] == 1);
+	CHECK(registry.watch_calls[APPROVED_KEY] == 1);
+
+	Autostart::SetRegistry(nullptr);
+}
+
+TEST(StartupStateInvalidatedByNotification)
+{
+	FakeRegistry &registry = InstallFakeRegistry();
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Enabled);
+
+	registry.Change(APPROVED_KEY, NAME, ApprovedStatus(3));
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::DisabledByUser);
+
+	// Only the key that changed is watched again.
+	CHECK(registry.watch_calls[RUN_KEY] == 1);
+	CHECK(registry.watch_calls[APPROVED_KEY] == 2);
+
+	registry.Change(APPROVED_KEY, NAME, ApprovedStatus(2));
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Enabled);
+
+	registry.Remove(RUN_KEY, NAME);
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Disabled);
+	CHECK(registry.watch_calls[RUN_KEY] == 2);
+	CHECK(registry.watch_calls[APPROVED_KEY] == 3);
+
+	Autostart::SetRegistry(nullptr);
+}
+
+TEST(StartupStateInvalidatedBySetStartupState)
+{
+	FakeRegistry &registry = InstallFakeRegistry();
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Enabled);
+
+	Autostart::SetStartupState(Autostart::StartupState::Disabled).get();
+	CHECK(registry.values.count({ RUN_KEY, NAME }) == 0);
+	CHECK(Autostart::GetCachedStartupState() == Autostart::StartupState::Disabled);
+
+	Autostart::SetRegistry(nullptr);
+}
\ No newline at end of file
@@ -0,0 +1,195 @@
+// Standard API
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Local stuff
+#include "../TranslucentTB/binarylog.hpp"
+#include "test.hpp"
+
+using MessageId = BinaryLog::MessageId;
+
+// Past this many different strings, the encoder stops adding to the string table.
+static constexpr std::size_t MAX_STRINGS = 16384;
+
+static constexpr uint64_t START_TICKS = 1000;
+
+static std::wstring DescribeHResult(const int32_t &hr)
+{
+	return L"HRESULT " + std::to_wstring(hr);
+}
+
+static BinaryLog::ENTRY Entry(const MessageId &id, std::initializer_list<int64_t> values, std::wstring text = { })
+{
+	BinaryLog::ENTRY entry = { };
+	entry.id = id;
+	entry.ticks = START_TICKS;
+	std::size_t i = 0;
+	for (const int64_t value : values)
+	{
+		entry.values[i++] = static_cast<uint64_t>(value);
+	}
+	entry.text = std::move(text);
+	return entry;
+}
+
+// A file header followed by nothing, records get appended to it.
+static std::vector<uint8_t> Header()
+{
+	BinaryLog::FILE_HEADER header = { };
+	header.magic = BinaryLog::MAGIC;
+	header.version = BinaryLog::VERSION;
+	header.start_time = 131000000000000000; // Some time in 2016
+	header.start_ticks = START_TICKS;
+	header.frequency = 1000;
+
+	const auto bytes = reinterpret_cast<const uint8_t *>(&header);
+	return { bytes, bytes + sizeof(header) };
+}
+
+// The decoded messages, without the time each line starts with.
+static std::vector<std::wstring> Messages(std::wstring_view text)
+{
+	std::vector<std::wstring> messages;
+	while (!text.empty())
+	{
+		const std::size_t end = text.find(L"\r\n");
+		const std::wstring_view line = text.substr(0, end);
+		messages.emplace_back(line.substr(line.find(L") ") + 2));
+		text.remove_prefix(end == std::wstring_view::npos ? text.length() : end + 2);
+	}
+
+	return messages;
+}
+
+static bool Decode(const std::vector<uint8_t> &data, std::vector<std::wstring> &messages)
+{
+	std::wstring text;
+	const bool complete = BinaryLog::Decode(data.data(), data.size(), text, DescribeHResult);
+	messages = Messages(text);
+	return complete;
+}
+
+TEST(BinaryLogRoundTripsIntegers)
+{
+	static constexpr int64_t VALUES[] = { 0, 1, -1, -64, 64, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max() };
+
+	BinaryLog::Encoder encoder(START_TICKS);
+	std::vector<uint8_t> data = Header();
+	for (const int64_t value : VALUES)
+	{
+		const std::size_t before = data.size();
+		encoder.Encode(Entry(MessageId::MessagesDropped, { value }), data);
+
+		// Tag, ticks and the value itself, one byte each for small negative numbers too.
+		if (value >= -64 && value < 64)
+		{
+			CHECK(data.size() - before == 3);
+		}
+	}
+
+	std::vector<std::wstring> messages;
+	CHECK(Decode(data, messages));
+	CHECK(messages.size() == std::size(VALUES));
+	for (std::size_t i = 0; i < messages.size() && i < std::size(VALUES); i++)
+	{
+		CHECK(messages[i] == std::to_wstring(VALUES[i]) + L" log messages were dropped because they were sent faster than they could be written.");
+	}
+}
+
+TEST(BinaryLogReferencesStringsAfterDefiningThem)
+{
+	BinaryLog::Encoder encoder(START_TICKS);
+	std::vector<uint8_t> data = Header();
+
+	const std::size_t first = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 6, -250 }, L"Loaded"), data);
+	const std::size_t second = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 6, 250 }, L"Loaded"), data);
+	const std::size_t third = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 6, 0 }, L"Parsed"), data);
+
+	// The first record defines the string, the second only references it.
+	CHECK(data[first] == 0);
+	CHECK(data[second] != 0);
+	CHECK(third - second < second - first);
+	CHECK(data[third] == 0);
+
+	std::vector<std::wstring> messages;
+	CHECK(Decode(data, messages));
+	CHECK(messages == std::vector<std::wstring>({ L"Loaded in -250 microseconds.", L"Loaded in 250 microseconds.", L"Parsed in 0 microseconds." }));
+}
+
+TEST(BinaryLogWritesStringsInlineWhenTableIsFull)
+{
+	BinaryLog::Encoder encoder(START_TICKS);
+	std::vector<uint8_t> data = Header();
+	for (std::size_t i = 0; i < MAX_STRINGS; i++)
+	{
+		const std::wstring string = std::to_wstring(i);
+		encoder.Encode(Entry(MessageId::ConfigLoaded, { static_cast<int64_t>(string.length()), 1 }, string), data);
+	}
+
+	// New strings no longer get a definition, strings already in the table are still referenced.
+	const std::size_t overflow = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 8, 2 }, L"Overflow"), data);
+	const std::size_t again = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 8, 3 }, L"Overflow"), data);
+	const std::size_t known = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 1, 4 }, L"0"), data);
+
+	CHECK(data[overflow] != 0);
+	CHECK(data[again] != 0);
+	CHECK(known - again == again - overflow);
+	CHECK(data.size() - known < again - overflow);
+
+	std::vector<std::wstring> messages;
+	CHECK(Decode(data, messages));
+	CHECK(messages.size() == MAX_STRINGS + 3);
+	if (messages.size() == MAX_STRINGS + 3)
+	{
+		CHECK(messages[MAX_STRINGS - 1] == std::to_wstring(MAX_STRINGS - 1) + L" in 1 microseconds.");
+		CHECK(messages[MAX_STRINGS] == L"Overflow in 2 microseconds.");
+		CHECK(messages[MAX_STRINGS + 1] == L"Overflow in 3 microseconds.");
+		CHECK(messages[MAX_STRINGS + 2] == L"0 in 4 microseconds.");
+	}
+}
+
+TEST(BinaryLogKeepsPrefixOfCorruptedFile)
+{
+	BinaryLog::Encoder encoder(START_TICKS);
+	std::vector<uint8_t> data = Header();
+	encoder.Encode(Entry(MessageId::Error, { 4, 5, 8, 42, 4 }, L"FailFile.cppMain"), data);
+	encoder.Encode(Entry(MessageId::RefreshingHandles, { }), data);
+	const std::size_t complete = data.size();
+	encoder.Encode(Entry(MessageId::ConfigLoaded, { 6, 300 }, L"Loaded"), data);
+
+	const std::vector<std::wstring> prefix = { L"Fail HRESULT 5 (File.cpp:42 at function Main)", L"Refreshing taskbar handles." };
+	std::vector<std::wstring> messages;
+
+	// Cut in the middle of the last record.
+	std::vector<uint8_t> truncated(data.begin(), data.end() - 1);
+	CHECK(!Decode(truncated, messages));
+	CHECK(messages == prefix);
+
+	// A tag past the end of the message table.
+	std::vector<uint8_t> corrupted(data.begin(), data.begin() + complete);
+	corrupted.push_back(0x7F);
+	CHECK(!Decode(corrupted, messages));
+	CHECK(messages == prefix);
+
+	// A string reference to a string that was never defined.
+	corrupted.resize(complete);
+	corrupted.insert(corrupted.end(), { static_cast<uint8_t>(static_cast<uint32_t>(MessageId::ConfigLoaded) + 1), 0, 100, 0 });
+	CHECK(!Decode(corrupted, messages));
+	CHECK(messages == prefix);
+
+	CHECK(Decode(data, messages));
+	CHECK(messages.size() == 3);
+}
\ No newline at end of file
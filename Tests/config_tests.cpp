@@ -0,0 +1,45 @@
+// Standard API
+#include <string>
+
+// Windows API
+#include "../TranslucentTB/arch.h"
+#include <fileapi.h>
+#include <minwindef.h>
+
+// Local stuff
+#include "../TranslucentTB/common.hpp"
+#include "../TranslucentTB/config.hpp"
+#include "test.hpp"
+
+static void DeleteConfig(const std::wstring &file)
+{
+	DeleteFile(file.c_str());
+	DeleteFile((file + CACHE_EXTENSION).c_str());
+}
+
+BENCHMARK(ConfigSnapshotAgainstParse)
+{
+	std::wstring file(MAX_PATH + 1, L'\0');
+	file.resize(GetTempPath(static_cast<DWORD>(file.length()), file.data()));
+	file += L"TranslucentTB.Tests.cfg";
+
+	// Every option, with its comment, like a file written by the program.
+	DeleteConfig(file);
+	Config defaults;
+	defaults.Save(file);
+
+	Config snapshot;
+	CHECK(Config::LoadSnapshot(file, snapshot));
+
+	Test::Measure("Config::Load", 1000, [&file]
+	{
+		Test::Consume(Config::Load(file).SLEEP_TIME);
+	});
+
+	Test::Measure("Config::LoadSnapshot", 1000, [&file, &snapshot]
+	{
+		Test::Consume(Config::LoadSnapshot(file, snapshot));
+	});
+
+	DeleteConfig(file);
+}
\ No newline at end of file
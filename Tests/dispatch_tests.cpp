@@ -0,0 +1,63 @@
+// Standard API
+#include <cstddef>
+#include <functional>
+
+// Windows API
+#include "../TranslucentTB/arch.h"
+#include <windef.h>
+#include <WinUser.h>
+
+// Local stuff
+#include "../TranslucentTB/messagewindow.hpp"
+#include "../TranslucentTB/smallfunction.hpp"
+#include "test.hpp"
+
+BENCHMARK(EventDispatch)
+{
+	static constexpr std::size_t ITERATIONS = 1000000;
+	std::size_t calls = 0;
+
+	// The same callable behind both, so only the cost of the call differs.
+	const auto callback = [&calls](WPARAM wParam, LPARAM) -> long
+	{
+		calls += wParam;
+		return 0;
+	};
+
+	std::function<long(WPARAM, LPARAM)> function = callback;
+	Test::Measure("std::function call", ITERATIONS, [&function]
+	{
+		function(1, 0);
+	});
+
+	MessageWindow::callback_t small_function = callback;
+	Test::Measure("SmallFunction call", ITERATIONS, [&small_function]
+	{
+		small_function(1, 0);
+	});
+
+	// Like the tray window: a handful of messages with callbacks, most messages going to DefWindowProc.
+	MessageWindow window(L"TTBDispatchBenchmark", L"TTBDispatchBenchmark");
+	for (unsigned int i = 0; i < 16; i++)
+	{
+		window.RegisterCallback(WM_APP + i, callback);
+	}
+	window.RegisterCallback(WM_APP + 8, callback);
+
+	Test::Measure("MessageWindow, registered message", ITERATIONS, [&window]
+	{
+		window.send_message(WM_APP + 3, 1);
+	});
+
+	Test::Measure("MessageWindow, message with two callbacks", ITERATIONS, [&window]
+	{
+		window.send_message(WM_APP + 8, 1);
+	});
+
+	Test::Measure("MessageWindow, unregistered message", ITERATIONS, [&window]
+	{
+		window.send_message(WM_USER + 3, 1);
+	});
+
+	Test::Consume(calls);
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+// Standard API
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Windows API
+#include "../TranslucentTB/arch.h"
+#include <windef.h>
+#include <winerror.h>
+#include <WinUser.h>
+
+// Local stuff
+#include "../TranslucentTB/ttberror.hpp"
+#include "test.hpp"
+
+// Stands in for MessageBox, and keeps every dialog up until the test closes it.
+static std::mutex dialogs_lock;
+static std::condition_variable dialogs_changed;
+static std::vector<std::wstring> shown_dialogs;
+static std::size_t closed_dialogs = 0;
+static bool hold_dialogs = false;
+
+static int WINAPI FakeMessageBox(HWND, const wchar_t *text, const wchar_t *, UINT)
+{
+	std::unique_lock guard(dialogs_lock);
+	shown_dialogs.emplace_back(text);
+	const std::size_t index = shown_dialogs.size();
+	dialogs_changed.notify_all();
+	dialogs_changed.wait(guard, [index]
+	{
+		return !hold_dialogs || closed_dialogs >= index;
+	});
+
+	return IDOK;
+}
+
+// Gives up after a while, so that a failure doesn't hang the tests.
+static bool WaitForDialogs(std::unique_lock<std::mutex> &guard, const std::size_t &count)
+{
+	return dialogs_changed.wait_for(guard, std::chrono::seconds(10), [&count]
+	{
+		return shown_dialogs.size() >= count;
+	});
+}
+
+static bool StartsWith(std::wstring_view text, std::wstring_view prefix)
+{
+	return text.substr(0, prefix.length()) == prefix;
+}
+
+TEST(ErrorDialogsDontBlockAndMerge)
+{
+	{
+		std::lock_guard guard(dialogs_lock);
+		shown_dialogs.clear();
+		closed_dialogs = 0;
+		hold_dialogs = true;
+	}
+	Error::SetMessageBox(&FakeMessageBox);
+
+	// Getting past this while the dialog is held up means that raising it didn't wait for it.
+	ErrorHandle(E_FAIL, Error::Level::Error, L"First error");
+	{
+		std::unique_lock guard(dialogs_lock);
+		CHECK(WaitForDialogs(guard, 1));
+	}
+
+	// Neither the message on screen nor the ones waiting are queued again.
+	ErrorHandle(E_FAIL, Error::Level::Error, L"First error");
+	for (int i = 0; i < 3; i++)
+	{
+		ErrorHandle(E_FAIL, Error::Level::Error, L"Second error");
+	}
+	ErrorHandle(E_FAIL, Error::Level::Error, L"Third error");
+
+	std::unique_lock guard(dialogs_lock);
+	for (std::size_t i = 1; i < 3; i++)
+	{
+		closed_dialogs = i;
+		dialogs_changed.notify_all();
+		CHECK(WaitForDialogs(guard, i + 1));
+	}
+
+	CHECK(shown_dialogs.size() == 3);
+	if (shown_dialogs.size() == 3)
+	{
+		CHECK(StartsWith(shown_dialogs[0], L"First error\n\n"));
+		CHECK(StartsWith(shown_dialogs[1], L"Second error\n\n"));
+		CHECK(StartsWith(shown_dialogs[2], L"Third error\n\n"));
+	}
+
+	// Later errors are still swallowed by the fake, without waiting for anyone.
+	hold_dialogs = false;
+	dialogs_changed.notify_all();
+}
\ No newline at end of file
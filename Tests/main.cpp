@@ -0,0 +1,54 @@
+// Standard API
+#include <cstdio>
+#include <cwchar>
+#include <string>
+
+// Windows API
+#include "../TranslucentTB/arch.h"
+#include <fileapi.h>
+
+// Local stuff
+#include "../TranslucentTB/ttblog.hpp"
+#include "test.hpp"
+
+unsigned int Test::m_Failures = 0;
+volatile std::size_t Test::m_Sink = 0;
+
+unsigned int Test::Run(const bool &benchmarks)
+{
+	unsigned int failed_cases = 0;
+	for (const CASE &test_case : Cases())
+	{
+		if (test_case.benchmark != benchmarks)
+		{
+			continue;
+		}
+
+		std::printf("%s\n", test_case.name);
+
+		const unsigned int failures = m_Failures;
+		test_case.function();
+		if (m_Failures != failures)
+		{
+			failed_cases++;
+		}
+	}
+
+	if (!benchmarks)
+	{
+		std::printf("%u test(s) failed, %u check(s) failed.\n", failed_cases, m_Failures);
+	}
+
+	return m_Failures;
+}
+
+int wmain(int argc, wchar_t *argv[])
+{
+	// The code under test logs, keep that and the log maintenance away from the user's logs.
+	std::wstring temp(MAX_PATH + 1, L'\0');
+	temp.resize(GetTempPath(static_cast<DWORD>(temp.length()), temp.data()));
+	Log::SetFolder(temp + L"TranslucentTB.Tests");
+
+	const bool benchmarks = argc > 1 && std::wcscmp(argv[1], L"--benchmark") == 0;
+	return Test::Run(benchmarks) == 0 ? 0 : 1;
+}
\ No newline at end of file
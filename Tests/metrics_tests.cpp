@@ -0,0 +1,173 @@
+// Standard API
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+// Windows API
+#include "../TranslucentTB/arch.h"
+#include <profileapi.h>
+
+// Local stuff
+#include "../TranslucentTB/metrics.hpp"
+#include "../TranslucentTB/tickschedule.hpp"
+#include "test.hpp"
+
+TEST(ToMicrosecondsDoesNotOverflow)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const uint64_t ticks_per_second = static_cast<uint64_t>(frequency.QuadPart);
+
+	CHECK(Metrics::ToMicroseconds(0) == 0);
+	CHECK(Metrics::ToMicroseconds(ticks_per_second) == 1000000);
+	CHECK(Metrics::ToMicroseconds(ticks_per_second / 2) == 500000);
+
+	// Well past the point where multiplying first overflows.
+	for (const uint64_t days : { 1, 30, 365, 10000 })
+	{
+		const uint64_t seconds = days * 86400;
+		CHECK(Metrics::ToMicroseconds(seconds * ticks_per_second) == seconds * 1000000);
+		CHECK(Metrics::ToMicroseconds(seconds * ticks_per_second + ticks_per_second / 4) == seconds * 1000000 + 250000);
+	}
+}
+
+// How the worker thread decides when to wake up and when to look at the desktop again.
+struct SCHEDULE {
+	const char *name;
+	uint32_t sleep_time;	// Milliseconds between wakeups when nothing happens
+	uint32_t evaluate_every;	// Ticks between full re-evaluations
+	bool wake_on_events;	// Whether events end the sleep early, like configuration changes do
+};
+
+struct ACTIVITY {
+	uint64_t time;	// Milliseconds since the start
+	bool changes_appearance;	// Most events leave the taskbar as it was, like switching between two restored windows
+};
+
+static constexpr uint64_t SIMULATED_TIME = 3600 * 1000;
+
+// An hour of desktop use, alternating between active periods with an event every few seconds and idle ones.
+// Seeded, so that every schedule sees the same hour.
+static std::vector<ACTIVITY> SimulateHour()
+{
+	std::mt19937_64 random(0x5454425F484F5552);
+	std::exponential_distribution<double> active_gap(1 / 4000.0), idle_gap(1 / 120000.0), period(1 / 300000.0);
+	std::bernoulli_distribution changes(0.4);
+
+	std::vector<ACTIVITY> activity;
+	bool active = true;
+	uint64_t time = 0, period_end = static_cast<uint64_t>(period(random));
+	while (true)
+	{
+		time += static_cast<uint64_t>(active ? active_gap(random) : idle_gap(random)) + 1;
+		while (time >= period_end)
+		{
+			active = !active;
+			period_end += static_cast<uint64_t>(period(random)) + 1;
+		}
+
+		if (time >= SIMULATED_TIME)
+		{
+			return activity;
+		}
+
+		activity.push_back({ time, changes(random) });
+	}
+}
+
+// Plays the hour against a schedule, through the same TickSchedule as the worker thread.
+// Simulated milliseconds become performance counter values plus one, because a zero origin means there is none.
+static void RunSchedule(const SCHEDULE &schedule, const std::vector<ACTIVITY> &activity)
+{
+	static constexpr uint32_t LATENCY = static_cast<uint32_t>(Metrics::Histogram::ForegroundLatency);
+	const std::unique_ptr<const Metrics::SNAPSHOT> before = std::make_unique<const Metrics::SNAPSHOT>(Metrics::Snapshot());
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const auto to_ticks = [&frequency](const uint64_t &milliseconds)
+	{
+		return milliseconds * static_cast<uint64_t>(frequency.QuadPart) / 1000 + 1;
+	};
+
+	TickSchedule tick_schedule(schedule.evaluate_every);
+	std::size_t next = 0;
+	uint64_t appearance = 0, applied = 0;
+	uint64_t time = 0;
+	while (time < SIMULATED_TIME)
+	{
+		bool woken = false;
+		for (; next != activity.size() && activity[next].time <= time; next++)
+		{
+			Metrics::EventOccurred(Metrics::Histogram::ForegroundLatency, to_ticks(activity[next].time));
+			woken = schedule.wake_on_events;
+			if (activity[next].changes_appearance)
+			{
+				appearance++;
+			}
+		}
+
+		// Reading the desktop applies every change made so far.
+		Metrics::Increment(Metrics::Counter::Wakeups);
+		bool changed = false;
+		if (tick_schedule.Begin(woken))
+		{
+			changed = applied != appearance;
+			applied = appearance;
+		}
+		tick_schedule.End(changed, to_ticks(time));
+
+		time += schedule.sleep_time;
+		if (schedule.wake_on_events && next != activity.size() && activity[next].time < time)
+		{
+			time = activity[next].time;
+		}
+	}
+
+	// Events left over at the end of the hour are not this schedule's concern.
+	Metrics::TakeEvents();
+
+	const std::unique_ptr<const Metrics::SNAPSHOT> after = std::make_unique<const Metrics::SNAPSHOT>(Metrics::Snapshot());
+	const auto counter_delta = [&before, &after](const Metrics::Counter &counter)
+	{
+		return after->counters[static_cast<uint32_t>(counter)] - before->counters[static_cast<uint32_t>(counter)];
+	};
+
+	const Metrics::HISTOGRAM_SNAPSHOT &latency_before = before->histograms[LATENCY];
+	const Metrics::HISTOGRAM_SNAPSHOT &latency_after = after->histograms[LATENCY];
+	const std::unique_ptr<Metrics::HISTOGRAM_SNAPSHOT> latency = std::make_unique<Metrics::HISTOGRAM_SNAPSHOT>();
+	latency->count = latency_after.count - latency_before.count;
+	latency->sum = latency_after.sum - latency_before.sum;
+	latency->max = UINT64_MAX;	// Unknown for a single run, so percentiles are bucket bounds
+	for (uint32_t i = 0; i < Metrics::BUCKET_COUNT; i++)
+	{
+		latency->buckets[i] = latency_after.buckets[i] - latency_before.buckets[i];
+	}
+
+	const uint64_t ticks = counter_delta(Metrics::Counter::Ticks);
+	std::printf("  %-48s %8.1f wakeups/s %7.3f%% idle %8llu us p50 %8llu us p99\n",
+		schedule.name,
+		counter_delta(Metrics::Counter::Wakeups) * 1000.0 / SIMULATED_TIME,
+		ticks != 0 ? counter_delta(Metrics::Counter::IdleTicks) * 100.0 / ticks : 0.0,
+		static_cast<unsigned long long>(latency->percentile(0.5)),
+		static_cast<unsigned long long>(latency->percentile(0.99)));
+}
+
+BENCHMARK(SchedulingOverAnHour)
+{
+	static constexpr SCHEDULE SCHEDULES[] = {
+		{ "Sleep 10 ms, re-evaluate every 10 ticks", 10, 10, false },
+		{ "Sleep 10 ms, re-evaluate every tick", 10, 0, false },
+		{ "Sleep 100 ms, re-evaluate every tick", 100, 0, false },
+		{ "Sleep 1 s, re-evaluate on events", 1000, 0, true }
+	};
+
+	const std::vector<ACTIVITY> activity = SimulateHour();
+	std::printf("  %zu events\n", activity.size());
+	for (const SCHEDULE &schedule : SCHEDULES)
+	{
+		RunSchedule(schedule, activity);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,82 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+// A minimal test runner. Tests and benchmarks register themselves at startup,
+// the runner calls them one after the other and counts the checks that failed.
+class Test {
+
+public:
+	struct CASE {
+		const char *name;
+		void (*function)();
+		bool benchmark;
+	};
+
+private:
+	static unsigned int m_Failures;
+	static volatile std::size_t m_Sink;
+
+	inline static std::vector<CASE> &Cases()
+	{
+		static std::vector<CASE> cases;
+		return cases;
+	}
+
+public:
+	inline static bool Register(const CASE &test_case)
+	{
+		Cases().push_back(test_case);
+		return true;
+	}
+
+	inline static void Fail(const char *file, const int &line, const char *expression)
+	{
+		std::printf("  %s(%d): check failed: %s\n", file, line, expression);
+		m_Failures++;
+	}
+
+	// Keeps the optimizer from removing the work of a benchmark.
+	inline static void Consume(const std::size_t &value)
+	{
+		m_Sink = m_Sink + value;
+	}
+
+	// Runs a function the given number of times and prints the average time of a call.
+	template<typename Function>
+	inline static void Measure(const char *name, const std::size_t &iterations, Function &&function)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		for (std::size_t i = 0; i < iterations; i++)
+		{
+			function();
+		}
+		const std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::printf("  %-48s %12.1f ns\n", name, elapsed.count() / iterations);
+	}
+
+	// Returns the number of failed checks.
+	static unsigned int Run(const bool &benchmarks);
+};
+
+#define TestCase(name, benchmark) \
+	static void name(); \
+	static const bool name##_registered = Test::Register({ #name, &name, (benchmark) }); \
+	static void name()
+
+// Defines a test, run every time.
+#define TEST(name) TestCase(name, false)
+
+// Defines a benchmark, only run when passing --benchmark.
+#define BENCHMARK(name) TestCase(name, true)
+
+#define CHECK(expression) do \
+{ \
+	if (!(expression)) \
+	{ \
+		Test::Fail(__FILE__, __LINE__, #expression); \
+	} \
+} while (false)
\ No newline at end of file
@@ -0,0 +1,169 @@
+// Standard API
+#include <algorithm>
+#include <cstddef>
+#include <cwctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Local stuff
+#include "../TranslucentTB/util.hpp"
+#include "test.hpp"
+
+// The vectorized paths work on blocks of 8 code units, these lengths cover
+// strings shorter than a block, exact blocks, and blocks followed by a tail.
+static constexpr std::size_t LENGTHS[] = { 1, 7, 8, 9, 16, 21 };
+
+static wchar_t ScalarToLower(const wchar_t &character)
+{
+	return static_cast<wchar_t>(std::towlower(character));
+}
+
+static bool ScalarIgnoreCaseEquals(std::wstring_view l, std::wstring_view r)
+{
+	return l.length() == r.length() && std::equal(l.begin(), l.end(), r.begin(), [](const wchar_t &a, const wchar_t &b)
+	{
+		return ScalarToLower(a) == ScalarToLower(b);
+	});
+}
+
+// An ASCII string with mixed case, to put the code unit under test in.
+static std::wstring Filler(const std::size_t &length)
+{
+	std::wstring filler;
+	for (std::size_t i = 0; i < length; i++)
+	{
+		filler += static_cast<wchar_t>((i % 2 ? L'a' : L'A') + i % 26);
+	}
+
+	return filler;
+}
+
+TEST(ToLowerMatchesScalar)
+{
+	for (unsigned int c = 1; c <= 0xFFFF; c++)
+	{
+		const wchar_t character = static_cast<wchar_t>(c);
+		CHECK(Util::ToLower(character) == ScalarToLower(character));
+
+		for (const std::size_t length : LENGTHS)
+		{
+			for (const std::size_t position : { std::size_t { 0 }, length / 2, length - 1 })
+			{
+				std::wstring text = Filler(length);
+				text[position] = character;
+
+				std::wstring expected = text;
+				std::transform(expected.begin(), expected.end(), expected.begin(), ScalarToLower);
+
+				Util::ToLowerInplace(text);
+				CHECK(text == expected);
+			}
+		}
+	}
+}
+
+TEST(IgnoreCaseStringEqualsMatchesScalar)
+{
+	for (unsigned int c = 1; c <= 0xFFFF; c++)
+	{
+		const wchar_t character = static_cast<wchar_t>(c);
+		const wchar_t others[] = {
+			character,
+			ScalarToLower(character),
+			static_cast<wchar_t>(std::towupper(character)),
+			static_cast<wchar_t>(character ^ 0x20),
+			static_cast<wchar_t>(character ^ 0x80),
+			L'A'
+		};
+
+		for (const std::size_t length : LENGTHS)
+		{
+			const std::wstring filler = Filler(length);
+			for (const wchar_t other : others)
+			{
+				for (const std::size_t position : { std::size_t { 0 }, length - 1 })
+				{
+					std::wstring left = filler, right = filler;
+					left[position] = character;
+					right[position] = other;
+
+					// Differ in the case of the filler too, so the ASCII fast path gets used.
+					std::transform(right.begin(), right.end(), right.begin(), [](const wchar_t &a)
+					{
+						return a < 0x80 ? static_cast<wchar_t>(std::towupper(a)) : a;
+					});
+					right[position] = other;
+
+					CHECK(Util::IgnoreCaseStringEquals(left, right) == ScalarIgnoreCaseEquals(left, right));
+					CHECK(Util::IgnoreCaseStringEquals(right, left) == ScalarIgnoreCaseEquals(right, left));
+				}
+			}
+		}
+	}
+
+	CHECK(!Util::IgnoreCaseStringEquals(L"explorer.exe", L"explorer.ex"));
+}
+
+// Typical inputs of the blacklist: executable paths and window class names.
+static std::vector<std::wstring> SampleStrings()
+{
+	return {
+		LR"(C:\Program Files\WindowsApps\Microsoft.WindowsCalculator_10.1806.1821.0_x64__8wekyb3d8bbwe\Calculator.exe)",
+		LR"(C:\Windows\System32\ApplicationFrameHost.exe)",
+		L"Windows.UI.Core.CoreWindow",
+		L"Shell_TrayWnd",
+		L"Chrome_WidgetWin_1"
+	};
+}
+
+BENCHMARK(CaseFolding)
+{
+	static constexpr std::size_t ITERATIONS = 1000000;
+	const std::vector<std::wstring> samples = SampleStrings();
+
+	Test::Measure("ToLowerInplace, scalar", ITERATIONS, [&samples, buffer = std::wstring()]() mutable
+	{
+		for (const std::wstring &sample : samples)
+		{
+			buffer = sample;
+			std::transform(buffer.begin(), buffer.end(), buffer.begin(), ScalarToLower);
+			Test::Consume(buffer[0]);
+		}
+	});
+
+	Test::Measure("ToLowerInplace", ITERATIONS, [&samples, buffer = std::wstring()]() mutable
+	{
+		for (const std::wstring &sample : samples)
+		{
+			buffer = sample;
+			Util::ToLowerInplace(buffer);
+			Test::Consume(buffer[0]);
+		}
+	});
+
+	std::vector<std::wstring> upper = samples;
+	for (std::wstring &sample : upper)
+	{
+		std::transform(sample.begin(), sample.end(), sample.begin(), [](const wchar_t &c)
+		{
+			return static_cast<wchar_t>(std::towupper(c));
+		});
+	}
+
+	Test::Measure("IgnoreCaseStringEquals, scalar", ITERATIONS, [&samples, &upper]
+	{
+		for (std::size_t i = 0; i < samples.size(); i++)
+		{
+			Test::Consume(ScalarIgnoreCaseEquals(samples[i], upper[i]));
+		}
+	});
+
+	Test::Measure("IgnoreCaseStringEquals", ITERATIONS, [&samples, &upper]
+	{
+		for (std::size_t i = 0; i < samples.size(); i++)
+		{
+			Test::Consume(Util::IgnoreCaseStringEquals(samples[i], upper[i]));
+		}
+	});
+}
\ No newline at end of file
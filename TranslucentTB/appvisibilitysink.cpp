@@ -1,10 +1,13 @@
 #include "appvisibilitysink.hpp"
 
+#include "metrics.hpp"
+
 AppVisibilitySink::AppVisibilitySink(bool &startOpened) : m_startOpenedRef(startOpened) { }
 
 IFACEMETHODIMP AppVisibilitySink::LauncherVisibilityChange(BOOL currentVisibleState)
 {
 	m_startOpenedRef = currentVisibleState;
+	Metrics::EventOccurred(Metrics::Histogram::StartLatency);
 	return S_OK;
 }
 
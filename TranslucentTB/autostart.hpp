@@ -1,12 +1,95 @@
 #pragma once
+#include "arch.h"
+#include <optional>
 #include <ppltasks.h>
+#ifndef STORE
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <windef.h>
+#include <winreg.h>
+#include <winrt/base.h>
+#endif
 #include <winrt/Windows.ApplicationModel.h>
 
+#ifndef STORE
+#include "registrykey.hpp"
+#endif
+
 class Autostart {
 
 public:
 	using StartupState = winrt::Windows::ApplicationModel::StartupTaskState;
 
+#ifndef STORE
+	// The part of HKEY_CURRENT_USER the startup state is kept in.
+	// An interface so the cache can be run against an in-memory registry.
+	class Registry {
+
+	public:
+		virtual LSTATUS GetValue(const wchar_t *key, const wchar_t *value, DWORD flags, void *data, DWORD *size) = 0;
+		virtual LSTATUS SetString(const wchar_t *key, const wchar_t *value, std::wstring_view data) = 0;
+		virtual LSTATUS DeleteValue(const wchar_t *key, const wchar_t *value) = 0;
+
+		// Signals the event once, the next time a value of the key changes or the key is created.
+		virtual LSTATUS NotifyChange(const wchar_t *key, HANDLE event) = 0;
+
+		virtual ~Registry() = default;
+	};
+
+private:
+	class SystemRegistry : public Registry {
+
+	private:
+		// A key that doesn't exist yet is watched through its closest existing parent, subkeys included.
+		struct WATCHED_KEY {
+			registry_key handle;
+			bool subtree;
+		};
+
+		// Notifications last as long as the key is open.
+		std::unordered_map<std::wstring, WATCHED_KEY> m_WatchedKeys;
+
+	public:
+		LSTATUS GetValue(const wchar_t *key, const wchar_t *value, DWORD flags, void *data, DWORD *size) override;
+		LSTATUS SetString(const wchar_t *key, const wchar_t *value, std::wstring_view data) override;
+		LSTATUS DeleteValue(const wchar_t *key, const wchar_t *value) override;
+		LSTATUS NotifyChange(const wchar_t *key, HANDLE event) override;
+	};
+
+	static constexpr const wchar_t *RUN_KEY = LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Run)";
+	static constexpr const wchar_t *APPROVED_KEY = LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Explorer\StartupApproved\Run)";
+
+	// A notification fires once, so each key has its own event and is only watched again after it changed.
+	struct WATCH {
+		const wchar_t *key;
+		winrt::handle changed;
+		bool armed;
+	};
+
+	// The cached state is valid until the event of either key is signaled.
+	static std::mutex m_Lock;
+	static std::unique_ptr<Registry> m_Registry;
+	static WATCH m_Watches[2];
+	static std::optional<StartupState> m_State;
+
+	static Registry &GetRegistry();
+	static bool TakeChanges();
+	static bool WatchChanges();
+	static StartupState QueryStartupState();
+#endif
+
+public:
+	// Returns the state right away when it is known without querying it, empty otherwise.
+	static std::optional<StartupState> GetCachedStartupState();
+
 	static concurrency::task<StartupState> GetStartupState();
 	static concurrency::task<void> SetStartupState(const StartupState &state);
+
+#ifndef STORE
+	// Replaces where the state is read from and written to, and drops the cached state.
+	static void SetRegistry(std::unique_ptr<Registry> registry);
+#endif
 };
\ No newline at end of file
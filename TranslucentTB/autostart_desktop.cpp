@@ -1,8 +1,10 @@
 #include "autostart.hpp"
 #include "arch.h"
 #include <cstdint>
+#include <stdexcept>
 #include <string>
-#include <vector>
+#include <synchapi.h>
+#include <utility>
 #include <WinBase.h>
 #include <winerror.h>
 #include <winreg.h>
@@ -12,34 +14,176 @@
 #include "ttberror.hpp"
 #include "win32.hpp"
 
-concurrency::task<Autostart::StartupState> Autostart::GetStartupState()
+std::mutex Autostart::m_Lock;
+std::unique_ptr<Autostart::Registry> Autostart::m_Registry;
+Autostart::WATCH Autostart::m_Watches[] = { { RUN_KEY, { }, false }, { APPROVED_KEY, { }, false } };
+std::optional<Autostart::StartupState> Autostart::m_State;
+
+LSTATUS Autostart::SystemRegistry::GetValue(const wchar_t *key, const wchar_t *value, DWORD flags, void *data, DWORD *size)
 {
-	return concurrency::create_task([]() -> StartupState
+	return RegGetValue(HKEY_CURRENT_USER, key, value, flags, NULL, data, size);
+}
+
+LSTATUS Autostart::SystemRegistry::SetString(const wchar_t *key, const wchar_t *value, std::wstring_view data)
+{
+	return RegSetKeyValue(HKEY_CURRENT_USER, key, value, REG_SZ, data.data(), static_cast<DWORD>(data.length() * sizeof(wchar_t)));
+}
+
+LSTATUS Autostart::SystemRegistry::DeleteValue(const wchar_t *key, const wchar_t *value)
+{
+	return RegDeleteKeyValue(HKEY_CURRENT_USER, key, value);
+}
+
+LSTATUS Autostart::SystemRegistry::NotifyChange(const wchar_t *key, HANDLE event)
+{
+	WATCHED_KEY &watched = m_WatchedKeys[key];
+	if (!watched.handle || watched.subtree)
 	{
-		LRESULT error = RegGetValue(HKEY_CURRENT_USER, LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Run)", NAME, RRF_RT_REG_SZ, NULL, NULL, NULL);
-		if (error == ERROR_FILE_NOT_FOUND)
-		{
-			return StartupState::Disabled;
-		}
-		else if (error == ERROR_SUCCESS)
+		// StartupApproved only exists once Task Manager touched it, and watching it must not create it.
+		// Until it shows up, its closest existing parent is watched, and opening it is tried again every time.
+		std::wstring path = key;
+		registry_key handle;
+		LSTATUS error;
+		while ((error = RegOpenKeyEx(HKEY_CURRENT_USER, path.c_str(), 0, KEY_NOTIFY, handle.put())) == ERROR_FILE_NOT_FOUND)
 		{
-			uint8_t status[12];
-			DWORD size = sizeof(status);
-			error = RegGetValue(HKEY_CURRENT_USER, LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Explorer\StartupApproved\Run)", NAME, RRF_RT_REG_BINARY, NULL, &status, &size);
-			if (error != ERROR_FILE_NOT_FOUND && ErrorHandle(HRESULT_FROM_WIN32(error), Error::Level::Log, L"Querying startup disable state failed.") && status[0] == 3)
+			const size_t separator = path.rfind(L'\\');
+			if (separator == std::wstring::npos)
 			{
-				return StartupState::DisabledByUser;
+				break;
 			}
-			else
+
+			path.resize(separator);
+		}
+
+		if (error != ERROR_SUCCESS)
+		{
+			m_WatchedKeys.erase(key);
+			return error;
+		}
+
+		watched.handle = std::move(handle);
+		watched.subtree = path != key;
+	}
+
+	// Creating a subkey only changes the name of its parent.
+	const DWORD filter = watched.subtree ? REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET : REG_NOTIFY_CHANGE_LAST_SET;
+	return RegNotifyChangeKeyValue(watched.handle.get(), watched.subtree, filter | REG_NOTIFY_THREAD_AGNOSTIC, event, true);
+}
+
+Autostart::Registry &Autostart::GetRegistry()
+{
+	if (!m_Registry)
+	{
+		m_Registry = std::make_unique<SystemRegistry>();
+	}
+
+	return *m_Registry;
+}
+
+bool Autostart::TakeChanges()
+{
+	bool changed = false;
+	for (WATCH &watch : m_Watches)
+	{
+		// Auto reset, so checking it also consumes the notification.
+		if (watch.armed && WaitForSingleObject(watch.changed.get(), 0) == WAIT_OBJECT_0)
+		{
+			watch.armed = false;
+			changed = true;
+		}
+	}
+
+	return changed;
+}
+
+bool Autostart::WatchChanges()
+{
+	Registry &registry = GetRegistry();
+	for (WATCH &watch : m_Watches)
+	{
+		if (watch.armed)
+		{
+			continue;
+		}
+
+		if (!watch.changed)
+		{
+			watch.changed.attach(CreateEvent(nullptr, false, false, nullptr));
+			if (!watch.changed)
 			{
-				return StartupState::Enabled;
+				LastErrorHandle(Error::Level::Log, L"Failed to create startup state change event.");
+				return false;
 			}
 		}
+
+		if (!ErrorHandle(HRESULT_FROM_WIN32(registry.NotifyChange(watch.key, watch.changed.get())), Error::Level::Log, L"Failed to watch startup registry key."))
+		{
+			return false;
+		}
+
+		watch.armed = true;
+	}
+
+	return true;
+}
+
+Autostart::StartupState Autostart::QueryStartupState()
+{
+	Registry &registry = GetRegistry();
+
+	LSTATUS error = registry.GetValue(RUN_KEY, NAME, RRF_RT_REG_SZ, NULL, NULL);
+	if (error == ERROR_FILE_NOT_FOUND)
+	{
+		return StartupState::Disabled;
+	}
+	else if (error == ERROR_SUCCESS)
+	{
+		uint8_t status[12];
+		DWORD size = sizeof(status);
+		error = registry.GetValue(APPROVED_KEY, NAME, RRF_RT_REG_BINARY, &status, &size);
+		if (error != ERROR_FILE_NOT_FOUND && ErrorHandle(HRESULT_FROM_WIN32(error), Error::Level::Log, L"Querying startup disable state failed.") && status[0] == 3)
+		{
+			return StartupState::DisabledByUser;
+		}
 		else
 		{
-			ErrorHandle(HRESULT_FROM_WIN32(error), Error::Level::Log, L"Querying startup state failed.");
-			return StartupState::Disabled;
+			return StartupState::Enabled;
 		}
+	}
+	else
+	{
+		ErrorHandle(HRESULT_FROM_WIN32(error), Error::Level::Log, L"Querying startup state failed.");
+		return StartupState::Disabled;
+	}
+}
+
+std::optional<Autostart::StartupState> Autostart::GetCachedStartupState()
+{
+	std::lock_guard guard(m_Lock);
+	if (TakeChanges() || !m_State)
+	{
+		// Watch before reading, so that a change made in between isn't missed.
+		m_State.reset();
+		if (WatchChanges())
+		{
+			m_State = QueryStartupState();
+		}
+	}
+
+	return m_State;
+}
+
+concurrency::task<Autostart::StartupState> Autostart::GetStartupState()
+{
+	if (const auto state = GetCachedStartupState())
+	{
+		return concurrency::task_from_result(*state);
+	}
+
+	return concurrency::create_task([]() -> StartupState
+	{
+		std::lock_guard guard(m_Lock);
+		return QueryStartupState();
 	});
 }
 
@@ -47,28 +191,37 @@ concurrency::task<void> Autostart::SetStartupState(const StartupState &state)
 {
 	return concurrency::create_task([=]
 	{
-		registry_key key = open_key(HKEY_CURRENT_USER, LR"(SOFTWARE\Microsoft\Windows\CurrentVersion\Run)");
-		if (key)
+		std::lock_guard guard(m_Lock);
+		Registry &registry = GetRegistry();
+		if (state == StartupState::Enabled)
 		{
-			if (state == StartupState::Enabled)
-			{
-				const std::wstring exeLocation = L'"' + win32::GetExeLocation() + L'"';
-
-				const LRESULT error = RegSetValueEx(key.get(), NAME, 0, REG_SZ, reinterpret_cast<const BYTE *>(exeLocation.c_str()), exeLocation.length() * sizeof(wchar_t));
-				ErrorHandle(HRESULT_FROM_WIN32(error), Error::Level::Error, L"Error while setting startup registry value!");
-			}
-			else if (state == StartupState::Disabled)
-			{
-				ErrorHandle(HRESULT_FROM_WIN32(RegDeleteValue(key.get(), NAME)), Error::Level::Error, L"Error while deleting startup registry value!");
-			}
-			else
-			{
-				throw std::invalid_argument("Can only set state to enabled or disabled");
-			}
+			const std::wstring exeLocation = L'"' + win32::GetExeLocation() + L'"';
+			ErrorHandle(HRESULT_FROM_WIN32(registry.SetString(RUN_KEY, NAME, exeLocation)), Error::Level::Error, L"Error while setting startup registry value!");
+		}
+		else if (state == StartupState::Disabled)
+		{
+			ErrorHandle(HRESULT_FROM_WIN32(registry.DeleteValue(RUN_KEY, NAME)), Error::Level::Error, L"Error while deleting startup registry value!");
 		}
 		else
 		{
-			LastErrorHandle(Error::Level::Error, L"Opening registry key failed!");
+			throw std::invalid_argument("Can only set state to enabled or disabled");
 		}
+
+		// The change notification would do it too, but don't depend on it.
+		m_State.reset();
 	});
+}
+
+void Autostart::SetRegistry(std::unique_ptr<Registry> registry)
+{
+	std::lock_guard guard(m_Lock);
+	m_Registry = std::move(registry);
+	m_State.reset();
+
+	// The notifications went away with the previous registry.
+	for (WATCH &watch : m_Watches)
+	{
+		watch.changed.close();
+		watch.armed = false;
+	}
 }
\ No newline at end of file
@@ -3,6 +3,12 @@
 #include "ttblog.hpp"
 #include "uwp.hpp"
 
+std::optional<Autostart::StartupState> Autostart::GetCachedStartupState()
+{
+	// The startup task has no change notification to keep a cache up to date with.
+	return std::nullopt;
+}
+
 concurrency::task<Autostart::StartupState> Autostart::GetStartupState()
 {
 	return concurrency::create_task([]() -> StartupState
@@ -0,0 +1,438 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <cwchar>
+#include <deque>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compact log format. Records reference a static table of messages instead of carrying their text,
+// strings that repeat are stored once per file, and timestamps are deltas from the previous record.
+// Shared with the LogDecoder tool, so it doesn't depend on anything else in the program.
+class BinaryLog {
+
+public:
+	enum class ArgumentType : uint8_t {
+		Integer,	// Signed integer
+		Handle,		// Window handle
+		HResult,	// Error code, described when formatted
+		String,		// Stored once per file, then referenced by index
+		Text		// Stored inline, for strings that are unlikely to repeat
+	};
+
+	// Only ever append to this, logs reference messages by index.
+	enum class MessageId : uint32_t {
+		Text,
+		Error,
+		BlacklistMatch,
+		BlacklistNoMatch,
+		RefreshingHandles,
+		BlacklistCacheCleared,
+		MessagesDropped,
+		ErrorRepeated,
+		ConfigLoaded,
+		ConfigUpToDate,
+		ConfigUnknownKey,
+		ConfigUnknownValue,
+		ConfigInvalidValue,
+		ConfigInvalidLine,
+		BlacklistLoaded,
+		TraceSaved
+	};
+
+	static constexpr size_t MAX_ARGUMENTS = 5;
+
+	struct MESSAGE {
+		std::wstring_view format;	// Every {} is replaced by the next argument
+		uint8_t argument_count;
+		ArgumentType arguments[MAX_ARGUMENTS];
+	};
+
+	static constexpr MESSAGE MESSAGES[] = {
+		{ L"{}", 1, { ArgumentType::Text } },
+		{ L"{} {} ({}:{} at function {})", 5, { ArgumentType::String, ArgumentType::HResult, ArgumentType::String, ArgumentType::Integer, ArgumentType::String } },
+		{ L"Blacklist match found for window: {} [{}] [{}] [{}]", 4, { ArgumentType::Handle, ArgumentType::String, ArgumentType::String, ArgumentType::String } },
+		{ L"No blacklist match found for window: {} [{}] [{}] [{}]", 4, { ArgumentType::Handle, ArgumentType::String, ArgumentType::String, ArgumentType::String } },
+		{ L"Refreshing taskbar handles.", 0, { } },
+		{ L"Blacklist cache cleared.", 0, { } },
+		{ L"{} log messages were dropped because they were sent faster than they could be written.", 1, { ArgumentType::Integer } },
+		{ L"{} from {}:{} was repeated {} more times.", 4, { ArgumentType::HResult, ArgumentType::String, ArgumentType::Integer, ArgumentType::Integer } },
+		{ L"{} in {} microseconds.", 2, { ArgumentType::String, ArgumentType::Integer } },
+		{ L"Configuration file is already up to date, not saving.", 0, { } },
+		{ L"Unknown key found in configuration file: {}", 1, { ArgumentType::Text } },
+		{ L"Unknown value found in configuration file: {} (for key: {})", 2, { ArgumentType::Text, ArgumentType::String } },
+		{ L"Could not parse {} found in configuration file: {} (for key: {})", 3, { ArgumentType::String, ArgumentType::Text, ArgumentType::String } },
+		{ L"Invalid line in configuration file: {}", 1, { ArgumentType::Text } },
+		{ L"Loaded compiled dynamic window blacklist.", 0, { } },
+		{ L"Saved a trace of the last {} seconds to {}", 2, { ArgumentType::Integer, ArgumentType::Text } }
+	};
+
+	// A log message. Strings are stored back to back in text, with their length in values.
+	struct ENTRY {
+		MessageId id;
+		uint64_t ticks;	// Performance counter value
+		uint64_t values[MAX_ARGUMENTS];
+		std::wstring text;
+	};
+
+	static constexpr uint32_t MAGIC = 0x4C425454; // TTBL
+	static constexpr uint32_t VERSION = 1;
+
+	// Followed by records. A record starts with a tag: 0 defines the next string of the string table,
+	// anything else is a message ID plus one, followed by the ticks elapsed since the previous record and the arguments.
+	struct FILE_HEADER {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t start_time;	// FILETIME matching start_ticks
+		uint64_t start_ticks;
+		uint64_t frequency;		// Ticks per second
+	};
+
+	using DescribeHResult = std::wstring (*)(const int32_t &hr);
+
+	// Appends the text of a message, without time nor line ending.
+	inline static void AppendText(const ENTRY &entry, std::wstring &out, const DescribeHResult &describe)
+	{
+		const MESSAGE &message = MESSAGES[static_cast<uint32_t>(entry.id)];
+		std::wstring_view format = message.format;
+		size_t text_offset = 0;
+		for (uint8_t i = 0; ; i++)
+		{
+			const size_t placeholder = format.find(L"{}");
+			out.append(format.substr(0, placeholder));
+			if (placeholder == std::wstring_view::npos || i == message.argument_count)
+			{
+				break;
+			}
+
+			const uint64_t &value = entry.values[i];
+			switch (message.arguments[i])
+			{
+			case ArgumentType::Integer:
+				out += std::to_wstring(static_cast<int64_t>(value));
+				break;
+			case ArgumentType::Handle:
+			{
+				wchar_t buffer[17];
+				std::swprintf(buffer, std::size(buffer), L"%0*llX", static_cast<int>(sizeof(void *) * 2), static_cast<unsigned long long>(value));
+				out += buffer;
+				break;
+			}
+			case ArgumentType::HResult:
+				out += describe(static_cast<int32_t>(value));
+				break;
+			case ArgumentType::String:
+			case ArgumentType::Text:
+				out.append(entry.text, text_offset, static_cast<size_t>(value));
+				text_offset += static_cast<size_t>(value);
+				break;
+			}
+
+			format.remove_prefix(placeholder + 2);
+		}
+	}
+
+	// Formats messages as lines of the text log.
+	class Formatter {
+
+	private:
+		FILE_HEADER m_Header;
+		DescribeHResult m_Describe;
+		std::time_t m_LastTime;
+		std::wstring m_TimeText;
+
+	public:
+		inline Formatter(const FILE_HEADER &header, const DescribeHResult &describe) :
+			m_Header(header),
+			m_Describe(describe),
+			m_LastTime(-1)
+		{ }
+
+		inline void Format(const ENTRY &entry, std::wstring &out)
+		{
+			// Unix timestamps are in seconds since 1970, FILETIME is in hundreds of nanoseconds since 1601.
+			const uint64_t elapsed = entry.ticks - m_Header.start_ticks;
+			const uint64_t filetime = m_Header.start_time + elapsed / m_Header.frequency * 10000000 + elapsed % m_Header.frequency * 10000000 / m_Header.frequency;
+			const std::time_t time = static_cast<std::time_t>(filetime / 10000000 - 11644473600);
+			if (time != m_LastTime)
+			{
+				m_TimeText = _wctime(&time);
+				m_TimeText.pop_back(); // Remove the newline created by _wctime
+				m_LastTime = time;
+			}
+
+			out += L'(';
+			out += m_TimeText;
+			out += L") ";
+			AppendText(entry, out, m_Describe);
+			out += L"\r\n";
+		}
+	};
+
+	// Turns messages into records.
+	class Encoder {
+
+	private:
+		// Past this, strings are written inline so that memory use stays bounded.
+		static constexpr size_t MAX_STRINGS = 16384;
+
+		// Looked up by view so that strings seen before cost no allocation. The deque never moves
+		// its elements, so the views stay valid. C++17 maps have no heterogeneous lookup to do it otherwise.
+		std::deque<std::wstring> m_StringStorage;
+		std::unordered_map<std::wstring_view, uint32_t> m_Strings;
+		uint64_t m_LastTicks;
+
+		inline static void WriteVarint(std::vector<uint8_t> &out, uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				out.push_back(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		inline static void WriteString(std::vector<uint8_t> &out, std::wstring_view string)
+		{
+			WriteVarint(out, string.length());
+			const size_t offset = out.size();
+			out.resize(offset + string.length() * sizeof(wchar_t));
+			std::memcpy(out.data() + offset, string.data(), string.length() * sizeof(wchar_t));
+		}
+
+	public:
+		inline explicit Encoder(const uint64_t &startTicks) : m_LastTicks(startTicks) { }
+
+		inline void Encode(const ENTRY &entry, std::vector<uint8_t> &out)
+		{
+			const MESSAGE &message = MESSAGES[static_cast<uint32_t>(entry.id)];
+
+			// String definitions have to come before the record using them.
+			uint32_t string_refs[MAX_ARGUMENTS] = { };
+			size_t text_offset = 0;
+			for (uint8_t i = 0; i < message.argument_count; i++)
+			{
+				const size_t length = static_cast<size_t>(entry.values[i]);
+				if (message.arguments[i] == ArgumentType::String)
+				{
+					const std::wstring_view string(entry.text.data() + text_offset, length);
+					if (const auto it = m_Strings.find(string); it != m_Strings.end())
+					{
+						string_refs[i] = it->second + 1;
+					}
+					else if (m_Strings.size() < MAX_STRINGS)
+					{
+						const uint32_t index = static_cast<uint32_t>(m_Strings.size());
+						m_Strings.emplace(m_StringStorage.emplace_back(string), index);
+						out.push_back(0);
+						WriteString(out, string);
+						string_refs[i] = index + 1;
+					}
+				}
+
+				if (message.arguments[i] == ArgumentType::String || message.arguments[i] == ArgumentType::Text)
+				{
+					text_offset += length;
+				}
+			}
+
+			WriteVarint(out, static_cast<uint64_t>(entry.id) + 1);
+			WriteVarint(out, entry.ticks - m_LastTicks);
+			m_LastTicks = entry.ticks;
+
+			text_offset = 0;
+			for (uint8_t i = 0; i < message.argument_count; i++)
+			{
+				const uint64_t &value = entry.values[i];
+				switch (message.arguments[i])
+				{
+				case ArgumentType::Integer:
+					// Zigzag encoding, so that small negative numbers stay small.
+					WriteVarint(out, (value << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63));
+					break;
+				case ArgumentType::Handle:
+					WriteVarint(out, value);
+					break;
+				case ArgumentType::HResult:
+					WriteVarint(out, static_cast<uint32_t>(value));
+					break;
+				case ArgumentType::String:
+					// 0 means the string follows inline.
+					WriteVarint(out, string_refs[i]);
+					if (string_refs[i] == 0)
+					{
+						WriteString(out, { entry.text.data() + text_offset, static_cast<size_t>(value) });
+					}
+					text_offset += static_cast<size_t>(value);
+					break;
+				case ArgumentType::Text:
+					WriteString(out, { entry.text.data() + text_offset, static_cast<size_t>(value) });
+					text_offset += static_cast<size_t>(value);
+					break;
+				}
+			}
+		}
+	};
+
+private:
+	class Reader {
+
+	private:
+		const uint8_t *m_Data;
+		const uint8_t *m_End;
+
+	public:
+		inline Reader(const uint8_t *data, const size_t &size) : m_Data(data), m_End(data + size) { }
+
+		inline bool done() const
+		{
+			return m_Data == m_End;
+		}
+
+		inline bool Read(void *out, const size_t &size)
+		{
+			if (static_cast<size_t>(m_End - m_Data) < size)
+			{
+				return false;
+			}
+
+			std::memcpy(out, m_Data, size);
+			m_Data += size;
+			return true;
+		}
+
+		inline bool ReadVarint(uint64_t &value)
+		{
+			value = 0;
+			for (unsigned int shift = 0; shift < 64 && m_Data != m_End; shift += 7)
+			{
+				const uint8_t byte = *m_Data++;
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+				{
+					return true;
+				}
+			}
+
+			return false;
+		}
+
+		inline bool ReadString(std::wstring &out)
+		{
+			uint64_t length;
+			if (!ReadVarint(length) || length > static_cast<size_t>(m_End - m_Data) / sizeof(wchar_t))
+			{
+				return false;
+			}
+
+			const size_t offset = out.length();
+			out.resize(offset + static_cast<size_t>(length));
+			return Read(out.data() + offset, static_cast<size_t>(length) * sizeof(wchar_t));
+		}
+	};
+
+public:
+	// Converts a binary log to the text format. Returns false if the data isn't a binary log, or is corrupted.
+	// In the latter case, everything before the corruption is still converted.
+	inline static bool Decode(const uint8_t *data, const size_t &size, std::wstring &result, const DescribeHResult &describe)
+	{
+		Reader reader(data, size);
+		FILE_HEADER header;
+		if (!reader.Read(&header, sizeof(header)) || header.magic != MAGIC || header.version != VERSION || header.frequency == 0)
+		{
+			return false;
+		}
+
+		Formatter formatter(header, describe);
+		std::vector<std::wstring> strings;
+		ENTRY entry = { };
+		entry.ticks = header.start_ticks;
+		while (!reader.done())
+		{
+			uint64_t tag;
+			if (!reader.ReadVarint(tag))
+			{
+				return false;
+			}
+
+			if (tag == 0)
+			{
+				if (!reader.ReadString(strings.emplace_back()))
+				{
+					return false;
+				}
+
+				continue;
+			}
+
+			uint64_t delta;
+			if (tag - 1 >= std::size(MESSAGES) || !reader.ReadVarint(delta))
+			{
+				return false;
+			}
+
+			entry.id = static_cast<MessageId>(tag - 1);
+			entry.ticks += delta;
+			entry.text.clear();
+
+			const MESSAGE &message = MESSAGES[tag - 1];
+			for (uint8_t i = 0; i < message.argument_count; i++)
+			{
+				uint64_t &value = entry.values[i];
+				bool success = true;
+				switch (message.arguments[i])
+				{
+				case ArgumentType::Integer:
+					success = reader.ReadVarint(value);
+					value = (value >> 1) ^ (~(value & 1) + 1);
+					break;
+				case ArgumentType::Handle:
+				case ArgumentType::HResult:
+					success = reader.ReadVarint(value);
+					break;
+				case ArgumentType::String:
+				{
+					uint64_t reference;
+					const size_t length = entry.text.length();
+					if (!reader.ReadVarint(reference) || reference > strings.size())
+					{
+						success = false;
+					}
+					else if (reference == 0)
+					{
+						success = reader.ReadString(entry.text);
+					}
+					else
+					{
+						entry.text += strings[static_cast<size_t>(reference - 1)];
+					}
+
+					value = entry.text.length() - length;
+					break;
+				}
+				case ArgumentType::Text:
+				{
+					const size_t length = entry.text.length();
+					success = reader.ReadString(entry.text);
+					value = entry.text.length() - length;
+					break;
+				}
+				}
+
+				if (!success)
+				{
+					return false;
+				}
+			}
+
+			formatter.Format(entry, result);
+		}
+
+		return true;
+	}
+};
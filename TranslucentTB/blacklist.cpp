@@ -1,123 +1,143 @@
 #include "blacklist.hpp"
 #include <fstream>
+#include <profileapi.h>
 #include <sstream>
 
-#include "config.hpp"
+#include "common.hpp"
+#include "mappedfile.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
 #include "ttblog.hpp"
 #include "util.hpp"
+#include "win32.hpp"
 
-std::vector<std::wstring> Blacklist::m_ClassBlacklist;
-std::vector<std::wstring> Blacklist::m_FileBlacklist;
-std::vector<std::wstring> Blacklist::m_TitleBlacklist;
+CompiledBlacklist Blacklist::m_Rules;
+
+std::unique_ptr<Blacklist::RULE_STATS[]> Blacklist::m_RuleStats;
+std::atomic<uint64_t> Blacklist::m_CacheHits;
+std::atomic<uint64_t> Blacklist::m_Misses;
+std::atomic<uint64_t> Blacklist::m_Evaluations;
+std::atomic<uint64_t> Blacklist::m_EvaluationTicks;
+std::atomic<uint64_t> Blacklist::m_MaxEvaluationTicks;
 
 std::recursive_mutex Blacklist::m_CacheLock;
-std::unordered_map<Window, bool> Blacklist::m_Cache;
+std::unordered_map<Window, uint32_t> Blacklist::m_Cache;
 
 void Blacklist::Parse(const std::wstring &file)
 {
 	std::lock_guard guard(m_CacheLock);
 
-	// Clear our vectors
-	m_ClassBlacklist.clear();
-	m_TitleBlacklist.clear();
-	m_FileBlacklist.clear();
+	// Let go of the current rules first, they might be mapped from the cache we are about to replace.
+	m_Rules.Reset();
 
-	const wchar_t delimiter = L',';
-	const wchar_t comment = L';';
-
-	std::wifstream excludesfilestream(file);
-	for (std::wstring line; std::getline(excludesfilestream, line);)
+	uint64_t source_hash = Util::HashBytes(nullptr, 0);
+	uint64_t source_size = 0;
+	bool cacheable = true;
 	{
-		Util::TrimInplace(line);
-		if (line.empty())
-		{
-			continue;
-		}
-
-		size_t comment_index = line.find(comment);
-		if (comment_index == 0)
-		{
-			continue;
-		}
-		else if (comment_index != std::wstring::npos)
+		const MappedFile source(file);
+		if (source)
 		{
-			line.erase(comment_index);
+			source_hash = Util::HashBytes(source.data(), source.size());
+			source_size = source.size();
 		}
-
-		if (line[line.length() - 1] != delimiter)
+		else
 		{
-			line += delimiter;
+			// A missing or empty file has no rules, and that is what the empty hash stands for.
+			// Anything else, like an editor holding the file, means we don't know what the cache should match.
+			const DWORD error = GetLastError();
+			cacheable = error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND || error == ERROR_FILE_INVALID;
 		}
+	}
 
-		std::wstring line_lowercase = Util::ToLower(line);
+	const std::wstring cache_file = file + CACHE_EXTENSION;
+	if (cacheable && m_Rules.Load(cache_file, source_hash, source_size))
+	{
+		LogMessage(Log::Level::Verbose, BinaryLog::MessageId::BlacklistLoaded);
+	}
+	else
+	{
+		std::vector<std::wstring> classes, files, titles;
+		ParseText(file, classes, files, titles);
 
-		if (Util::StringBeginsWith(line_lowercase, L"class"))
-		{
-			AddToVector(std::move(line), m_ClassBlacklist, delimiter);
-		}
-		else if (Util::StringBeginsWith(line_lowercase, L"title") || Util::StringBeginsWith(line_lowercase, L"windowtitle"))
-		{
-			AddToVector(std::move(line), m_TitleBlacklist, delimiter);
-		}
-		else if (Util::StringBeginsWith(line_lowercase, L"exename"))
+		std::vector<uint8_t> image = CompiledBlacklist::Compile(classes, files, titles, source_hash, source_size);
+		if (cacheable)
 		{
-			AddToVector(std::move(line_lowercase), m_FileBlacklist, delimiter);
-		}
-		else
-		{
-			Log::OutputMessage(L"Invalid line in dynamic window blacklist file.");
+			CompiledBlacklist::Save(cache_file, image);
 		}
+		m_Rules.Adopt(std::move(image));
 	}
 
+	ResetStatistics();
 	ClearCache();
 }
 
 bool Blacklist::IsBlacklisted(const Window &window)
 {
+	TraceScope("Blacklist::IsBlacklisted");
 	std::lock_guard guard(m_CacheLock);
 
-	if (m_Cache.count(window) != 0)
+	uint32_t rule;
+	if (const auto it = m_Cache.find(window); it != m_Cache.end())
 	{
-		return m_Cache.at(window);
+		m_CacheHits.fetch_add(1, std::memory_order_relaxed);
+		Metrics::Increment(Metrics::Counter::BlacklistCacheHits);
+		rule = it->second;
 	}
 	else
 	{
+		Metrics::Increment(Metrics::Counter::BlacklistCacheMisses);
+
+		LARGE_INTEGER start;
+		QueryPerformanceCounter(&start);
+
 		// This is the fastest because we do the less string manipulation, so always try it first
-		if (m_ClassBlacklist.size() > 0)
+		rule = m_Rules.has_class_rules() ? m_Rules.MatchClass(*window.classname()) : CompiledBlacklist::npos;
+
+		if (rule == CompiledBlacklist::npos && m_Rules.has_file_rules())
 		{
-			for (const std::wstring &value : m_ClassBlacklist)
-			{
-				if (*window.classname() == value)
-				{
-					return OutputMatchToLog(window, m_Cache[window] = true);
-				}
-			}
+			rule = m_Rules.MatchFile(*window.filename());
 		}
 
-		if (m_FileBlacklist.size() > 0)
+		// Do it last because titles can change, so it's less reliable.
+		if (rule == CompiledBlacklist::npos && m_Rules.has_title_rules())
 		{
-			for (const std::wstring &value : m_FileBlacklist)
-			{
-				if (Util::IgnoreCaseStringEquals(*window.filename(), value))
-				{
-					return OutputMatchToLog(window, m_Cache[window] = true);
-				}
-			}
+			rule = m_Rules.MatchTitle(*window.title());
 		}
 
-		// Do it last because titles can change, so it's less reliable.
-		if (m_TitleBlacklist.size() > 0)
+		LARGE_INTEGER end;
+		QueryPerformanceCounter(&end);
+
+		const uint64_t ticks = end.QuadPart - start.QuadPart;
+		m_Evaluations.fetch_add(1, std::memory_order_relaxed);
+		m_EvaluationTicks.fetch_add(ticks, std::memory_order_relaxed);
+		if (ticks > m_MaxEvaluationTicks.load(std::memory_order_relaxed))
 		{
-			for (const std::wstring &value : m_TitleBlacklist)
-			{
-				if (window.title()->find(value) != std::wstring::npos)
-				{
-					return OutputMatchToLog(window, m_Cache[window] = true);
-				}
-			}
+			m_MaxEvaluationTicks.store(ticks, std::memory_order_relaxed);
 		}
 
-		return OutputMatchToLog(window, m_Cache[window] = false);
+		// Counted here rather than on every lookup, so that a rule's hits are the windows it matched,
+		// not how many ticks they stayed around for.
+		if (rule != CompiledBlacklist::npos)
+		{
+			RULE_STATS &stats = m_RuleStats[rule];
+			stats.hits.fetch_add(1, std::memory_order_relaxed);
+			stats.last_window.store(window, std::memory_order_relaxed);
+			stats.last_time.store(std::time(0), std::memory_order_relaxed);
+		}
+
+		m_Cache[window] = rule;
+		LogMessage(Log::Level::Verbose, rule != CompiledBlacklist::npos ? BinaryLog::MessageId::BlacklistMatch : BinaryLog::MessageId::BlacklistNoMatch,
+			window.handle(), *window.classname(), *window.filename(), *window.title());
+	}
+
+	if (rule != CompiledBlacklist::npos)
+	{
+		return true;
+	}
+	else
+	{
+		m_Misses.fetch_add(1, std::memory_order_relaxed);
+		return false;
 	}
 }
 
@@ -128,40 +148,158 @@ void Blacklist::ClearCache()
 		m_Cache.clear();
 	}
 
-	if (Config::VERBOSE)
-	{
-		Log::OutputMessage(L"Blacklist cache cleared.");
-	}
+	LogMessage(Log::Level::Verbose, BinaryLog::MessageId::BlacklistCacheCleared);
 }
 
-void Blacklist::AddToVector(std::wstring line, std::vector<std::wstring> &vector, const wchar_t &delimiter)
+bool Blacklist::DumpStatistics(const std::wstring &file)
 {
-	size_t pos;
+	static constexpr const wchar_t *KIND_NAMES[] = { L"class", L"exename", L"title" };
 
-	// First lets remove the key
-	if ((pos = line.find(delimiter)) != std::wstring::npos)
+	struct RULE_ROW {
+		CompiledBlacklist::RuleKind kind;
+		std::wstring value;
+		uint64_t hits;
+		Window last_window;
+		std::time_t last_time;
+	};
+
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const double microseconds_per_tick = 1000000.0 / frequency.QuadPart;
+
+	std::wostringstream dump;
+	dump << L'\uFEFF';
+
+	// Copy the rules out, so that looking at the windows they matched doesn't hold up the worker.
+	std::vector<RULE_ROW> rows;
 	{
-		line.erase(0, pos + 1);
+		std::lock_guard guard(m_CacheLock);
+
+		const uint64_t evaluations = m_Evaluations.load(std::memory_order_relaxed);
+		dump << L"Dynamic window blacklist statistics: " << m_Rules.rule_count() << L" rules, ";
+		dump << m_CacheHits.load(std::memory_order_relaxed) << L" cache hits, ";
+		dump << evaluations << L" evaluations, ";
+		dump << m_Misses.load(std::memory_order_relaxed) << L" lookups without a match.";
+		if (evaluations != 0)
+		{
+			dump << L" Evaluation took " << m_EvaluationTicks.load(std::memory_order_relaxed) * microseconds_per_tick / evaluations;
+			dump << L" microseconds on average, " << m_MaxEvaluationTicks.load(std::memory_order_relaxed) * microseconds_per_tick << L" at most.";
+		}
+		dump << L"\r\n";
+
+		rows.reserve(m_Rules.rule_count());
+		for (uint32_t i = 0; i < m_Rules.rule_count(); i++)
+		{
+			const RULE_STATS &stats = m_RuleStats[i];
+			rows.push_back({
+				m_Rules.rule_kind(i),
+				std::wstring(m_Rules.rule_value(i)),
+				stats.hits.load(std::memory_order_relaxed),
+				stats.last_window.load(std::memory_order_relaxed),
+				stats.last_time.load(std::memory_order_relaxed)
+			});
+		}
 	}
 
-	// Now iterate and add the values
-	while ((pos = line.find(delimiter)) != std::wstring::npos)
+	const std::time_t now = std::time(0);
+	for (const RULE_ROW &row : rows)
 	{
-		vector.push_back(Util::Trim(line.substr(0, pos)));
-		line.erase(0, pos + 1);
+		dump << KIND_NAMES[static_cast<uint32_t>(row.kind)] << L" [" << row.value << L"]: " << row.hits << L" hits";
+		if (row.hits != 0)
+		{
+			dump << L", last matched " << now - row.last_time << L" seconds ago by window " << row.last_window.handle();
+			if (row.last_window.valid())
+			{
+				dump << L" [" << *row.last_window.classname() << L"] [" << *row.last_window.filename() << L"] [" << *row.last_window.title() << L']';
+			}
+			else
+			{
+				dump << L" (destroyed)";
+			}
+		}
+		dump << L"\r\n";
 	}
+
+	const std::wstring text = dump.str();
+	return win32::WriteFileAtomically(file, text.data(), text.length() * sizeof(wchar_t));
 }
 
-const bool &Blacklist::OutputMatchToLog(const Window &window, const bool &isMatch)
+void Blacklist::ParseText(const std::wstring &file, std::vector<std::wstring> &classes, std::vector<std::wstring> &files, std::vector<std::wstring> &titles)
 {
-	if (Config::VERBOSE)
+	const wchar_t delimiter = L',';
+	const wchar_t comment = L';';
+
+	std::wifstream excludesfilestream(file);
+	for (std::wstring line; std::getline(excludesfilestream, line);)
 	{
-		std::wostringstream message;
-		message << (isMatch ? L"B" : L"No b") << L"lacklist match found for window: ";
-		message << window.handle() << L" [" << *window.classname() << L"] [" << *window.filename() << L"] [" << *window.title() << L']';
+		Util::TrimInplace(line);
+		if (line.empty())
+		{
+			continue;
+		}
+
+		size_t comment_index = line.find(comment);
+		if (comment_index == 0)
+		{
+			continue;
+		}
+		else if (comment_index != std::wstring::npos)
+		{
+			line.erase(comment_index);
+		}
 
-		Log::OutputMessage(message.str());
+		if (line[line.length() - 1] != delimiter)
+		{
+			line += delimiter;
+		}
+
+		std::wstring line_lowercase = Util::ToLower(line);
+
+		if (Util::StringBeginsWith(line_lowercase, L"class"))
+		{
+			AddToVector(line, classes, delimiter);
+		}
+		else if (Util::StringBeginsWith(line_lowercase, L"title") || Util::StringBeginsWith(line_lowercase, L"windowtitle"))
+		{
+			AddToVector(line, titles, delimiter);
+		}
+		else if (Util::StringBeginsWith(line_lowercase, L"exename"))
+		{
+			AddToVector(line_lowercase, files, delimiter);
+		}
+		else
+		{
+			Log::OutputMessage(L"Invalid line in dynamic window blacklist file.");
+		}
 	}
+}
+
+void Blacklist::ResetStatistics()
+{
+	std::lock_guard guard(m_CacheLock);
+
+	m_RuleStats = std::make_unique<RULE_STATS[]>(m_Rules.rule_count());
+	m_CacheHits.store(0, std::memory_order_relaxed);
+	m_Misses.store(0, std::memory_order_relaxed);
+	m_Evaluations.store(0, std::memory_order_relaxed);
+	m_EvaluationTicks.store(0, std::memory_order_relaxed);
+	m_MaxEvaluationTicks.store(0, std::memory_order_relaxed);
+}
 
-	return isMatch;
+void Blacklist::AddToVector(const std::wstring &line, std::vector<std::wstring> &vector, const wchar_t &delimiter)
+{
+	// First lets skip the key
+	size_t start = line.find(delimiter);
+	if (start == std::wstring::npos)
+	{
+		return;
+	}
+
+	// Now iterate and add the values
+	size_t pos;
+	while ((pos = line.find(delimiter, ++start)) != std::wstring::npos)
+	{
+		vector.push_back(Util::Trim(line.substr(start, pos - start)));
+		start = pos;
+	}
 }
\ No newline at end of file
@@ -1,10 +1,14 @@
 #pragma once
+#include <atomic>
 #include <cstdint>
+#include <ctime>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "compiledblacklist.hpp"
 #include "eventhook.hpp"
 #include "window.hpp"
 
@@ -15,17 +19,33 @@ public:
 	static bool IsBlacklisted(const Window &window);
 	static void ClearCache();
 
+	// Writes every rule with its hit count and last matched window to a text file, along with match timings.
+	static bool DumpStatistics(const std::wstring &file);
+
 private:
-	static std::vector<std::wstring> m_ClassBlacklist;
-	static std::vector<std::wstring> m_FileBlacklist;
-	static std::vector<std::wstring> m_TitleBlacklist;
+	struct RULE_STATS {
+		std::atomic<uint64_t> hits;	// Evaluations that matched, cached lookups don't count
+		std::atomic<HWND> last_window;
+		std::atomic<std::time_t> last_time;
+	};
+
+	static CompiledBlacklist m_Rules;
+
+	// Indexed like the rules of m_Rules, and replaced along with them.
+	static std::unique_ptr<RULE_STATS[]> m_RuleStats;
+	static std::atomic<uint64_t> m_CacheHits;
+	static std::atomic<uint64_t> m_Misses;
+	static std::atomic<uint64_t> m_Evaluations;
+	static std::atomic<uint64_t> m_EvaluationTicks;
+	static std::atomic<uint64_t> m_MaxEvaluationTicks;
 
 	static std::recursive_mutex m_CacheLock;
-	static std::unordered_map<Window, bool> m_Cache;
+	static std::unordered_map<Window, uint32_t> m_Cache; // Index of the matching rule, or CompiledBlacklist::npos
 
 	friend class Hooks;
 
-	static void AddToVector(std::wstring line, std::vector<std::wstring> &vector, const wchar_t &delimiter = L',');
-	static const bool &OutputMatchToLog(const Window &window, const bool &isMatch);
+	static void ParseText(const std::wstring &file, std::vector<std::wstring> &classes, std::vector<std::wstring> &files, std::vector<std::wstring> &titles);
+	static void AddToVector(const std::wstring &line, std::vector<std::wstring> &vector, const wchar_t &delimiter = L',');
+	static void ResetStatistics();
 
 };
\ No newline at end of file
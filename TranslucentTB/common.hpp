@@ -22,11 +22,20 @@ static constexpr wchar_t CONFIG_FILE[] = L"config.cfg";
 // Dynamic windows exclude file name
 static constexpr wchar_t EXCLUDE_FILE[] = L"dynamic-ws-exclude.csv";
 
+// Extension appended to a configuration file name to get the name of its compiled cache
+static constexpr wchar_t CACHE_EXTENSION[] = L".cache";
+
 // Message sent by explorer when the taskbar is created
 static constexpr wchar_t WM_TASKBARCREATED[] = L"TaskbarCreated";
 
 // Message used by a new instance to close the old instance
 static constexpr wchar_t NEW_TTB_INSTANCE[] = L"NewTTBInstance";
 
+// Message used by color pickers to hand a new color to the thread owning it
+static constexpr wchar_t WM_COLORCHANGED[] = L"TTBColorChanged";
+
+// Message used by background threads to hand a freshly loaded configuration to the main thread
+static constexpr wchar_t WM_CONFIGLOADED[] = L"TTBConfigLoaded";
+
 // Window class used by UWP
 static constexpr wchar_t CORE_WINDOW[] = L"Windows.UI.Core.CoreWindow";
\ No newline at end of file
@@ -0,0 +1,504 @@
+#include "compiledblacklist.hpp"
+#include "arch.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+#include <unordered_map>
+
+#include "ttberror.hpp"
+#include "util.hpp"
+#include "win32.hpp"
+
+std::vector<uint8_t> CompiledBlacklist::Compile(const std::vector<std::wstring> &classes, const std::vector<std::wstring> &files, const std::vector<std::wstring> &titles, const uint64_t &sourceHash, const uint64_t &sourceSize)
+{
+	std::vector<RULE> rules;
+	std::vector<wchar_t> strings;
+	rules.reserve(classes.size() + files.size() + titles.size());
+
+	const auto add_rules = [&rules, &strings](const std::vector<std::wstring> &values, const RuleKind &kind)
+	{
+		for (const std::wstring &value : values)
+		{
+			rules.push_back({ static_cast<uint32_t>(kind), static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(value.length()) });
+			strings.insert(strings.end(), value.begin(), value.end());
+		}
+	};
+
+	add_rules(classes, RuleKind::Class);
+	add_rules(files, RuleKind::File);
+	add_rules(titles, RuleKind::Title);
+
+	std::vector<STATE> states;
+	std::vector<EDGE> edges;
+	BuildAutomaton(rules, strings, states, edges);
+
+	HEADER header { MAGIC, VERSION, sourceHash, sourceSize };
+	std::vector<uint8_t> image(sizeof(header));
+
+	header.rules = AppendSection(image, rules);
+	header.strings = AppendSection(image, strings);
+	header.class_table = AppendSection(image, BuildTable(rules, strings, RuleKind::Class));
+	header.file_table = AppendSection(image, BuildTable(rules, strings, RuleKind::File));
+	header.states = AppendSection(image, states);
+	header.edges = AppendSection(image, edges);
+	header.image_size = static_cast<uint32_t>(image.size());
+
+	std::memcpy(image.data(), &header, sizeof(header));
+	return image;
+}
+
+bool CompiledBlacklist::Save(const std::wstring &file, const std::vector<uint8_t> &image)
+{
+	if (!win32::WriteFileAtomically(file, image.data(), image.size()))
+	{
+		LastErrorHandle(Error::Level::Log, L"Failed to write compiled blacklist file.");
+		return false;
+	}
+
+	return true;
+}
+
+CompiledBlacklist::CompiledBlacklist() :
+	m_Rules(),
+	m_Strings(),
+	m_ClassTable(),
+	m_FileTable(),
+	m_States(),
+	m_Edges()
+{ }
+
+bool CompiledBlacklist::Load(const std::wstring &file, const uint64_t &sourceHash, const uint64_t &sourceSize)
+{
+	Reset();
+
+	m_File = MappedFile(file);
+	if (!m_File)
+	{
+		return false;
+	}
+
+	const HEADER &header = *reinterpret_cast<const HEADER *>(m_File.data());
+	if (m_File.size() < sizeof(header) || header.source_hash != sourceHash || header.source_size != sourceSize ||
+		!Attach(m_File.data(), m_File.size()))
+	{
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+bool CompiledBlacklist::Adopt(std::vector<uint8_t> &&image)
+{
+	Reset();
+
+	m_Image = std::move(image);
+	if (!Attach(m_Image.data(), m_Image.size()))
+	{
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+void CompiledBlacklist::Reset()
+{
+	m_Rules = { };
+	m_Strings = { };
+	m_ClassTable = { };
+	m_FileTable = { };
+	m_States = { };
+	m_Edges = { };
+
+	m_File.reset();
+	m_Image.clear();
+	m_Image.shrink_to_fit();
+}
+
+uint32_t CompiledBlacklist::MatchClass(std::wstring_view classname) const
+{
+	return Find(m_ClassTable, classname, RuleKind::Class);
+}
+
+uint32_t CompiledBlacklist::MatchFile(std::wstring_view filename) const
+{
+	return Find(m_FileTable, filename, RuleKind::File);
+}
+
+uint32_t CompiledBlacklist::MatchTitle(std::wstring_view title) const
+{
+	const auto &[states, count] = m_States;
+	if (count == 0)
+	{
+		return npos;
+	}
+
+	uint32_t state = 0;
+	for (const wchar_t &character : title)
+	{
+		// An empty rule is an output of the root, so it is checked on the first iteration.
+		if (states[state].output != npos)
+		{
+			return states[state].output;
+		}
+
+		uint32_t next;
+		while ((next = Transition(states, m_Edges.first, state, character)) == npos && state != 0)
+		{
+			state = states[state].fail;
+		}
+
+		if (next != npos)
+		{
+			state = next;
+		}
+	}
+
+	return states[state].output;
+}
+
+bool CompiledBlacklist::Attach(const uint8_t *data, const size_t &size)
+{
+	if (size < sizeof(HEADER) || reinterpret_cast<uintptr_t>(data) % alignof(HEADER) != 0)
+	{
+		return false;
+	}
+
+	const HEADER &header = *reinterpret_cast<const HEADER *>(data);
+	if (header.magic != MAGIC || header.version != VERSION || header.image_size != size)
+	{
+		return false;
+	}
+
+	if (!GetSection(data, size, header.rules, m_Rules) ||
+		!GetSection(data, size, header.strings, m_Strings) ||
+		!GetSection(data, size, header.class_table, m_ClassTable) ||
+		!GetSection(data, size, header.file_table, m_FileTable) ||
+		!GetSection(data, size, header.states, m_States) ||
+		!GetSection(data, size, header.edges, m_Edges))
+	{
+		return false;
+	}
+
+	// We don't trust the file, so check every reference it makes to be sure we never read out of it or loop forever.
+	for (uint32_t i = 0; i < m_Rules.second; i++)
+	{
+		const RULE &rule = m_Rules.first[i];
+		if (rule.kind > static_cast<uint32_t>(RuleKind::Title) || rule.offset > m_Strings.second || rule.length > m_Strings.second - rule.offset)
+		{
+			return false;
+		}
+	}
+
+	for (const auto &[table, kind] : { std::make_pair(m_ClassTable, RuleKind::Class), std::make_pair(m_FileTable, RuleKind::File) })
+	{
+		if ((table.second & (table.second - 1)) != 0)
+		{
+			return false;
+		}
+
+		bool has_empty = table.second == 0;
+		for (uint32_t i = 0; i < table.second; i++)
+		{
+			const uint32_t &rule = table.first[i].rule;
+			if (rule == npos)
+			{
+				has_empty = true;
+			}
+			else if (rule >= m_Rules.second || m_Rules.first[rule].kind != static_cast<uint32_t>(kind))
+			{
+				return false;
+			}
+		}
+
+		if (!has_empty)
+		{
+			return false;
+		}
+	}
+
+	if (m_States.second == 0 && m_Edges.second != 0)
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < m_States.second; i++)
+	{
+		const STATE &state = m_States.first[i];
+		if ((i == 0 ? state.fail != 0 : state.fail >= i) ||
+			(state.output != npos && (state.output >= m_Rules.second || m_Rules.first[state.output].kind != static_cast<uint32_t>(RuleKind::Title))) ||
+			state.first_edge > m_Edges.second || state.edge_count > m_Edges.second - state.first_edge)
+		{
+			return false;
+		}
+
+		for (uint32_t j = state.first_edge; j < state.first_edge + state.edge_count; j++)
+		{
+			if (m_Edges.first[j].target <= i || m_Edges.first[j].target >= m_States.second)
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+uint32_t CompiledBlacklist::Find(const std::pair<const SLOT *, uint32_t> &table, std::wstring_view value, const RuleKind &kind) const
+{
+	const auto &[slots, count] = table;
+	if (count == 0)
+	{
+		return npos;
+	}
+
+	const uint32_t mask = count - 1;
+	const uint32_t hash = Hash(value, kind);
+	for (uint32_t i = hash & mask; ; i = (i + 1) & mask)
+	{
+		const SLOT &slot = slots[i];
+		if (slot.rule == npos)
+		{
+			return npos;
+		}
+		else if (slot.hash == hash && Equals(rule_value(slot.rule), value, kind))
+		{
+			return slot.rule;
+		}
+	}
+}
+
+template<typename T>
+bool CompiledBlacklist::GetSection(const uint8_t *data, const size_t &size, const SECTION &section, std::pair<const T *, uint32_t> &result)
+{
+	if (section.offset < sizeof(HEADER) || section.offset > size || section.offset % alignof(uint64_t) != 0 ||
+		section.count > (size - section.offset) / sizeof(T))
+	{
+		return false;
+	}
+
+	result = { reinterpret_cast<const T *>(data + section.offset), section.count };
+	return true;
+}
+
+template<typename T>
+CompiledBlacklist::SECTION CompiledBlacklist::AppendSection(std::vector<uint8_t> &image, const std::vector<T> &data)
+{
+	image.resize((image.size() + alignof(uint64_t) - 1) & ~(alignof(uint64_t) - 1));
+
+	const SECTION section = { static_cast<uint32_t>(image.size()), static_cast<uint32_t>(data.size()) };
+	const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data.data());
+	image.insert(image.end(), bytes, bytes + data.size() * sizeof(T));
+
+	return section;
+}
+
+uint32_t CompiledBlacklist::Hash(std::wstring_view value, const RuleKind &kind)
+{
+	// FNV-1a on UTF-16 code units. Executable names are folded so that the lookup is case-insensitive.
+	uint32_t hash = 2166136261u;
+	for (const wchar_t &character : value)
+	{
+		hash ^= kind == RuleKind::File ? Util::ToLower(character) : character;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+bool CompiledBlacklist::Equals(std::wstring_view rule, std::wstring_view value, const RuleKind &kind)
+{
+	if (kind == RuleKind::File)
+	{
+		return Util::IgnoreCaseStringEquals(rule, value);
+	}
+	else
+	{
+		return rule == value;
+	}
+}
+
+uint32_t CompiledBlacklist::Transition(const STATE *states, const EDGE *edges, const uint32_t &state, const uint32_t &character)
+{
+	const EDGE *first = edges + states[state].first_edge;
+	const EDGE *last = first + states[state].edge_count;
+
+	const EDGE *edge = std::lower_bound(first, last, character, [](const EDGE &e, const uint32_t &c) -> bool
+	{
+		return e.character < c;
+	});
+
+	return edge != last && edge->character == character ? edge->target : npos;
+}
+
+std::vector<CompiledBlacklist::SLOT> CompiledBlacklist::BuildTable(const std::vector<RULE> &rules, const std::vector<wchar_t> &strings, const RuleKind &kind)
+{
+	const size_t count = std::count_if(rules.begin(), rules.end(), [&kind](const RULE &rule) -> bool
+	{
+		return rule.kind == static_cast<uint32_t>(kind);
+	});
+
+	if (count == 0)
+	{
+		return { };
+	}
+
+	// At most half full, so probe sequences stay short and there always is an empty slot to stop at.
+	size_t size = 1;
+	while (size < count * 2)
+	{
+		size <<= 1;
+	}
+
+	std::vector<SLOT> table(size, { 0, npos });
+	for (uint32_t i = 0; i < rules.size(); i++)
+	{
+		if (rules[i].kind != static_cast<uint32_t>(kind))
+		{
+			continue;
+		}
+
+		const std::wstring_view value(strings.data() + rules[i].offset, rules[i].length);
+		const uint32_t hash = Hash(value, kind);
+		for (size_t j = hash & (size - 1); ; j = (j + 1) & (size - 1))
+		{
+			SLOT &slot = table[j];
+			if (slot.rule == npos)
+			{
+				slot = { hash, i };
+				break;
+			}
+			else if (slot.hash == hash && Equals({ strings.data() + rules[slot.rule].offset, rules[slot.rule].length }, value, kind))
+			{
+				// Duplicate rule, the first one wins.
+				break;
+			}
+		}
+	}
+
+	return table;
+}
+
+void CompiledBlacklist::BuildAutomaton(const std::vector<RULE> &rules, const std::vector<wchar_t> &strings, std::vector<STATE> &states, std::vector<EDGE> &edges)
+{
+	// First build a trie of all the title rules, keyed by parent node and character.
+	std::unordered_map<uint64_t, uint32_t> children;
+	std::vector<uint32_t> terminal(1, npos);
+	bool has_titles = false;
+
+	for (uint32_t i = 0; i < rules.size(); i++)
+	{
+		if (rules[i].kind != static_cast<uint32_t>(RuleKind::Title))
+		{
+			continue;
+		}
+
+		has_titles = true;
+		uint32_t node = 0;
+		for (uint32_t j = rules[i].offset; j < rules[i].offset + rules[i].length; j++)
+		{
+			const uint64_t key = (static_cast<uint64_t>(node) << 16) | static_cast<uint16_t>(strings[j]);
+			const auto [it, inserted] = children.try_emplace(key, static_cast<uint32_t>(terminal.size()));
+			if (inserted)
+			{
+				terminal.push_back(npos);
+			}
+
+			node = it->second;
+		}
+
+		if (terminal[node] == npos)
+		{
+			terminal[node] = i;
+		}
+	}
+
+	if (!has_titles)
+	{
+		return;
+	}
+
+	// Sort the trie edges by parent and character, so each node's edges are contiguous and ready for a binary search.
+	std::vector<std::tuple<uint32_t, uint32_t, uint32_t>> trie_edges;
+	trie_edges.reserve(children.size());
+	for (const auto &[key, child] : children)
+	{
+		trie_edges.emplace_back(static_cast<uint32_t>(key >> 16), static_cast<uint32_t>(key & 0xFFFF), child);
+	}
+	children.clear();
+	std::sort(trie_edges.begin(), trie_edges.end());
+
+	const size_t node_count = terminal.size();
+	std::vector<uint32_t> first_edge(node_count + 1, 0);
+	for (const auto &edge : trie_edges)
+	{
+		first_edge[std::get<0>(edge) + 1]++;
+	}
+	for (size_t i = 0; i < node_count; i++)
+	{
+		first_edge[i + 1] += first_edge[i];
+	}
+
+	// Renumber the nodes in breadth-first order. This makes every failure link point to a lower state,
+	// which is what lets Attach verify that matching can't loop forever on a corrupted file.
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> number(node_count);
+	order.reserve(node_count);
+	order.push_back(0);
+	for (size_t head = 0; head < order.size(); head++)
+	{
+		const uint32_t node = order[head];
+		for (uint32_t i = first_edge[node]; i < first_edge[node + 1]; i++)
+		{
+			const uint32_t child = std::get<2>(trie_edges[i]);
+			number[child] = static_cast<uint32_t>(order.size());
+			order.push_back(child);
+		}
+	}
+
+	states.resize(node_count);
+	edges.reserve(trie_edges.size());
+	for (uint32_t i = 0; i < node_count; i++)
+	{
+		const uint32_t node = order[i];
+		states[i] = { static_cast<uint32_t>(edges.size()), first_edge[node + 1] - first_edge[node], 0, terminal[node] };
+		for (uint32_t j = first_edge[node]; j < first_edge[node + 1]; j++)
+		{
+			edges.push_back({ std::get<1>(trie_edges[j]), number[std::get<2>(trie_edges[j])] });
+		}
+	}
+
+	// Compute failure links and propagate outputs. In breadth-first order, everything a state
+	// depends on has already been computed by the time we reach it.
+	for (uint32_t i = 0; i < node_count; i++)
+	{
+		for (uint32_t j = states[i].first_edge; j < states[i].first_edge + states[i].edge_count; j++)
+		{
+			const EDGE &edge = edges[j];
+
+			uint32_t fail = 0;
+			if (i != 0)
+			{
+				uint32_t state = states[i].fail;
+				uint32_t next;
+				while ((next = Transition(states.data(), edges.data(), state, edge.character)) == npos && state != 0)
+				{
+					state = states[state].fail;
+				}
+
+				if (next != npos)
+				{
+					fail = next;
+				}
+			}
+
+			STATE &target = states[edge.target];
+			target.fail = fail;
+			if (target.output == npos)
+			{
+				target.output = states[fail].output;
+			}
+		}
+	}
+}
\ No newline at end of file
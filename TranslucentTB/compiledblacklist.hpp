@@ -0,0 +1,151 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "mappedfile.hpp"
+
+// A blacklist compiled to a flat image made of hash tables and a substring matching automaton.
+// The image can be written to disk and mapped back read-only, then used as-is without any parsing.
+class CompiledBlacklist {
+
+public:
+	enum class RuleKind : uint32_t {
+		Class,	// Exact match on the window class name
+		File,	// Case-insensitive match on the executable name
+		Title	// Window title contains the value
+	};
+
+	// Returned by the match functions when no rule matched.
+	static constexpr uint32_t npos = UINT32_MAX;
+
+	// Compiles rules to an image. sourceHash and sourceSize identify the file the rules came from.
+	static std::vector<uint8_t> Compile(const std::vector<std::wstring> &classes, const std::vector<std::wstring> &files, const std::vector<std::wstring> &titles, const uint64_t &sourceHash, const uint64_t &sourceSize);
+
+	// Writes an image to disk, through a temporary file so that a reader never sees half of it.
+	static bool Save(const std::wstring &file, const std::vector<uint8_t> &image);
+
+	CompiledBlacklist();
+
+	// Maps an image from disk. Fails if the image is corrupt or wasn't compiled from the given source.
+	bool Load(const std::wstring &file, const uint64_t &sourceHash, const uint64_t &sourceSize);
+
+	// Takes ownership of an image in memory.
+	bool Adopt(std::vector<uint8_t> &&image);
+
+	void Reset();
+
+	// All of those return the index of the matching rule, or npos.
+	uint32_t MatchClass(std::wstring_view classname) const;
+	uint32_t MatchFile(std::wstring_view filename) const;
+	uint32_t MatchTitle(std::wstring_view title) const;
+
+	inline bool has_class_rules() const
+	{
+		return m_ClassTable.second != 0;
+	}
+
+	inline bool has_file_rules() const
+	{
+		return m_FileTable.second != 0;
+	}
+
+	inline bool has_title_rules() const
+	{
+		return m_States.second != 0;
+	}
+
+	inline uint32_t rule_count() const
+	{
+		return m_Rules.second;
+	}
+
+	inline RuleKind rule_kind(const uint32_t &rule) const
+	{
+		return static_cast<RuleKind>(m_Rules.first[rule].kind);
+	}
+
+	inline std::wstring_view rule_value(const uint32_t &rule) const
+	{
+		return { m_Strings.first + m_Rules.first[rule].offset, m_Rules.first[rule].length };
+	}
+
+	inline CompiledBlacklist(const CompiledBlacklist &) = delete;
+	inline CompiledBlacklist &operator =(const CompiledBlacklist &) = delete;
+
+private:
+	// On-disk layout. Every section is an array aligned on 8 bytes, located by its offset from the start of the image.
+	struct SECTION {
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	struct HEADER {
+		uint32_t magic;
+		uint32_t version;
+		uint64_t source_hash;
+		uint64_t source_size;
+		uint32_t image_size;
+		uint32_t reserved;
+		SECTION  rules;			// RULE
+		SECTION  strings;		// wchar_t, referenced by rules
+		SECTION  class_table;	// SLOT, open addressing with a power of two size
+		SECTION  file_table;	// SLOT, same but keys are hashed case-insensitively
+		SECTION  states;		// STATE, numbered in breadth-first order. State 0 is the root.
+		SECTION  edges;			// EDGE, grouped by state and sorted by character
+	};
+
+	struct RULE {
+		uint32_t kind;
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	struct SLOT {
+		uint32_t hash;
+		uint32_t rule;	// npos if the slot is empty
+	};
+
+	struct STATE {
+		uint32_t first_edge;
+		uint32_t edge_count;
+		uint32_t fail;		// Always a lower state, so following failure links terminates
+		uint32_t output;	// Rule matched when reaching this state, or npos
+	};
+
+	struct EDGE {
+		uint32_t character;
+		uint32_t target;
+	};
+
+	static constexpr uint32_t MAGIC = 0x42425454; // TTBB
+	static constexpr uint32_t VERSION = 1;
+
+	MappedFile m_File;
+	std::vector<uint8_t> m_Image;
+
+	std::pair<const RULE *, uint32_t> m_Rules;
+	std::pair<const wchar_t *, uint32_t> m_Strings;
+	std::pair<const SLOT *, uint32_t> m_ClassTable;
+	std::pair<const SLOT *, uint32_t> m_FileTable;
+	std::pair<const STATE *, uint32_t> m_States;
+	std::pair<const EDGE *, uint32_t> m_Edges;
+
+	bool Attach(const uint8_t *data, const size_t &size);
+	uint32_t Find(const std::pair<const SLOT *, uint32_t> &table, std::wstring_view value, const RuleKind &kind) const;
+
+	template<typename T>
+	static bool GetSection(const uint8_t *data, const size_t &size, const SECTION &section, std::pair<const T *, uint32_t> &result);
+	template<typename T>
+	static SECTION AppendSection(std::vector<uint8_t> &image, const std::vector<T> &data);
+
+	static uint32_t Hash(std::wstring_view value, const RuleKind &kind);
+	static bool Equals(std::wstring_view rule, std::wstring_view value, const RuleKind &kind);
+	static uint32_t Transition(const STATE *states, const EDGE *edges, const uint32_t &state, const uint32_t &character);
+
+	static std::vector<SLOT> BuildTable(const std::vector<RULE> &rules, const std::vector<wchar_t> &strings, const RuleKind &kind);
+	static void BuildAutomaton(const std::vector<RULE> &rules, const std::vector<wchar_t> &strings, std::vector<STATE> &states, std::vector<EDGE> &edges);
+};
\ No newline at end of file
@@ -1,447 +1,818 @@
 #include "config.hpp"
-#include <fstream>
+#include "arch.h"
+#include <array>
+#include <climits>
+#include <cstring>
+#include <fileapi.h>
 #include <iomanip>
+#include <new>
+#include <profileapi.h>
 #include <sstream>
+#include <string_view>
+#include <stringapiset.h>
+#include <type_traits>
+#include <winrt/base.h>
 
 #include "common.hpp"
+#include "mappedfile.hpp"
+#include "tracing.hpp"
+#include "ttberror.hpp"
 #include "ttblog.hpp"
 #include "util.hpp"
 #include "win32.hpp"
 
-// Defaults
-
-// Regular
-Config::TASKBAR_APPEARANCE Config::REGULAR_APPEARANCE = { swca::ACCENT::ACCENT_ENABLE_TRANSPARENTGRADIENT, 0x0 };
+#pragma region Schema
+
+enum class OPTION_TYPE {
+	Accent,		// ACCENT of appearance
+	Color,		// RGB part of the COLOR of appearance
+	Opacity,	// Alpha part of the COLOR of appearance
+	Bool,		// setting
+	Peek,		// PEEK
+	SleepTime,	// SLEEP_TIME
+	LogBudget	// LOG_BUDGET
+};
+
+// One key of the configuration file. The key is prefix followed by name, or prefix followed by alias.
+struct OPTION {
+	OPTION_TYPE type;
+	std::wstring_view prefix;
+	std::wstring_view name;
+	std::wstring_view alias;
+	Config::TASKBAR_APPEARANCE Config::*appearance;
+	bool Config::*setting;
+	std::wstring_view header;	// Lines written before the option
+	std::wstring_view comment;	// Written after the value
+	uint8_t width;				// Width the value is padded to when followed by a comment
+};
+
+// Replaced by MIN_FLUENT_BUILD when saving.
+static constexpr std::wstring_view FLUENT_BUILD_TOKEN = L"{fluent build}";
+
+static constexpr std::wstring_view COLOR_COMMENT = L"A color in hexadecimal notation.";
+static constexpr std::wstring_view OPACITY_COMMENT = L"A value in the range 0 to 255.";
+
+static constexpr OPTION Setting(const OPTION_TYPE &type, std::wstring_view name, bool Config::*setting, std::wstring_view header = L"", std::wstring_view comment = L"")
+{
+	return { type, L"", name, L"", nullptr, setting, header, comment, 0 };
+}
 
-// Maximised
-bool Config::MAXIMISED_ENABLED = true;
-Config::TASKBAR_APPEARANCE Config::MAXIMISED_APPEARANCE = { swca::ACCENT::ACCENT_ENABLE_BLURBEHIND, 0xaa000000 };
-bool Config::MAXIMISED_REGULAR_ON_PEEK = true;
+// Accent, color and opacity of a taskbar state.
+static constexpr std::array<OPTION, 3> Appearance(std::wstring_view prefix, Config::TASKBAR_APPEARANCE Config::*appearance, std::wstring_view header = L"", std::wstring_view accentComment = L"", const uint8_t &accentWidth = 0)
+{
+	const bool dash = !prefix.empty();
+	return { {
+		{ OPTION_TYPE::Accent,  prefix, dash ? L"-accent" : L"accent",   L"",                           appearance, nullptr, header, accentComment,   accentWidth },
+		{ OPTION_TYPE::Color,   prefix, dash ? L"-color" : L"color",     dash ? L"-tint" : L"tint",     appearance, nullptr, L"",    COLOR_COMMENT,   0 },
+		{ OPTION_TYPE::Opacity, prefix, dash ? L"-opacity" : L"opacity", L"",                           appearance, nullptr, L"",    OPACITY_COMMENT, 4 }
+	} };
+}
 
-// Start
-bool Config::START_ENABLED = true;
-Config::TASKBAR_APPEARANCE Config::START_APPEARANCE = { swca::ACCENT::ACCENT_NORMAL, 0x0 };
+// A dynamic mode: its toggle followed by its appearance.
+static constexpr std::array<OPTION, 4> DynamicMode(std::wstring_view prefix, bool Config::*enabled, Config::TASKBAR_APPEARANCE Config::*appearance, std::wstring_view header)
+{
+	const std::array<OPTION, 3> options = Appearance(prefix, appearance);
+	return { {
+		{ OPTION_TYPE::Bool, prefix, L"", L"", nullptr, enabled, header, L"", 0 },
+		options[0],
+		options[1],
+		options[2]
+	} };
+}
 
-// Cortana
-bool Config::CORTANA_ENABLED = true;
-Config::TASKBAR_APPEARANCE Config::CORTANA_APPEARANCE = { swca::ACCENT::ACCENT_NORMAL, 0x0 };
+template<std::size_t... sizes>
+static constexpr std::array<OPTION, (sizes + ...)> Concat(const std::array<OPTION, sizes> &...arrays)
+{
+	std::array<OPTION, (sizes + ...)> result = { };
+	std::size_t i = 0;
+	([&result, &i](const auto &options)
+	{
+		for (const OPTION &option : options)
+		{
+			result[i++] = option;
+		}
+	}(arrays), ...);
 
-// Timeline/Task View
-bool Config::TIMELINE_ENABLED = true;
-Config::TASKBAR_APPEARANCE Config::TIMELINE_APPEARANCE = { swca::ACCENT::ACCENT_NORMAL, 0x0 };
+	return result;
+}
 
-// Peek
-enum Config::PEEK Config::PEEK = PEEK::Dynamic;
-bool Config::PEEK_ONLY_MAIN = true;
+// Save writes the options in this order. Adding a dynamic mode only needs a DynamicMode here.
+static constexpr auto OPTIONS = Concat(
+	Appearance(L"", &Config::REGULAR_APPEARANCE, L"", L"accent values are: clear (default), fluent (only on build {fluent build} and up), opaque, normal, or blur.", 5),
+	DynamicMode(L"dynamic-ws", &Config::MAXIMISED_ENABLED, &Config::MAXIMISED_APPEARANCE,
+		L"\n; Dynamic Modes\n; they all have their own accent, color and opacity configs.\n\n; Dynamic Windows. State to use when a window is maximised.\n"),
+	std::array<OPTION, 1> { {
+		{ OPTION_TYPE::Bool, L"dynamic-ws", L"-regular-on-peek", L"", nullptr, &Config::MAXIMISED_REGULAR_ON_PEEK, L"", L"when using aero peek, behave as if no window was maximised.", 0 }
+	} },
+	DynamicMode(L"dynamic-start", &Config::START_ENABLED, &Config::START_APPEARANCE,
+		L"\n; Dynamic Start. State to use when the start menu is opened.\n"),
+	DynamicMode(L"dynamic-cortana", &Config::CORTANA_ENABLED, &Config::CORTANA_APPEARANCE,
+		L"\n; Dynamic Cortana. State to use when Cortana or the search menu is opened.\n"),
+	DynamicMode(L"dynamic-timeline", &Config::TIMELINE_ENABLED, &Config::TIMELINE_APPEARANCE,
+		L"\n; Dynamic Timeline. State to use when the timeline (or task view on older builds) is opened.\n"),
+	std::array<OPTION, 7> { {
+		Setting(OPTION_TYPE::Peek, L"peek", nullptr, L"\n; Controls how the Aero Peek button behaves (dynamic, show or hide)\n"),
+		Setting(OPTION_TYPE::Bool, L"peek-only-main", &Config::PEEK_ONLY_MAIN, L"", L"Decides wether only the main monitor is considered when dynamic peek is enabled."),
+		Setting(OPTION_TYPE::SleepTime, L"sleep-time", nullptr,
+			L"\n; Advanced settings\n; sleep time in milliseconds, a shorter time reduces flicker when opening start, but results in higher CPU usage.\n"),
+		Setting(OPTION_TYPE::Bool, L"no-tray", &Config::NO_TRAY, L"; hide icon in system tray. Changes to this requires a restart of the application.\n"),
+		Setting(OPTION_TYPE::Bool, L"verbose", &Config::VERBOSE, L"; more informative logging. Can make huge log files.\n"),
+		Setting(OPTION_TYPE::Bool, L"binary-log", &Config::BINARY_LOG, L"; write the log in a compact binary format, which LogDecoder turns back into text. Changes to this requires a restart of the application.\n"),
+		Setting(OPTION_TYPE::LogBudget, L"log-budget", nullptr,
+			L"; disk space in megabytes that log files can use. The oldest are deleted first, and logs older than a week are always deleted.\n")
+	} }
+);
+
+// FNV-1a over the prefix then the name, so that both parts hash like the whole key.
+static constexpr uint32_t HashKey(std::wstring_view prefix, std::wstring_view name, const uint32_t &seed)
+{
+	uint32_t hash = 2166136261u ^ seed;
+	for (const std::wstring_view part : { prefix, name })
+	{
+		for (const wchar_t &character : part)
+		{
+			hash ^= character;
+			hash *= 16777619u;
+		}
+	}
 
-// Advanced
-uint8_t Config::SLEEP_TIME = 10;
-bool Config::NO_TRAY = false;
-bool Config::VERBOSE =
-#ifndef _DEBUG
-	false;
-#else
-	true;
-#endif
+	// Mix the high bits in, only the low ones are used to pick a slot.
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	return hash;
+}
 
-std::mutex Config::m_ConfigLock;
+static constexpr std::size_t KEY_TABLE_SIZE = 128;
 
-void Config::Parse(const std::wstring &file)
+// Finds a seed for which every key and alias lands in a different slot.
+static constexpr uint32_t FindKeySeed()
 {
-	std::lock_guard guard(m_ConfigLock);
-
-	std::wifstream configstream(file);
-	for (std::wstring line; std::getline(configstream, line);)
+	for (uint32_t seed = 0; ; seed++)
 	{
-		if (line.empty())
+		bool used[KEY_TABLE_SIZE] = { };
+		bool collision = false;
+		for (const OPTION &option : OPTIONS)
 		{
-			continue;
-		}
+			bool &slot = used[HashKey(option.prefix, option.name, seed) % KEY_TABLE_SIZE];
+			collision |= slot;
+			slot = true;
 
-		// Skip comments
-		size_t comment_index = line.find(L';');
-		if (comment_index == 0)
-		{
-			continue;
+			if (!option.alias.empty())
+			{
+				bool &alias_slot = used[HashKey(option.prefix, option.alias, seed) % KEY_TABLE_SIZE];
+				collision |= alias_slot;
+				alias_slot = true;
+			}
 		}
-		else if (comment_index != std::wstring::npos)
+
+		if (!collision)
 		{
-			line.erase(comment_index);
+			return seed;
 		}
+	}
+}
 
-		size_t split_index = line.find(L'=');
-		if (split_index != std::wstring::npos)
-		{
-			Util::ToLowerInplace(line);
-			const std::wstring key = Util::Trim(line.substr(0, split_index));
-			const std::wstring val = Util::Trim(line.substr(split_index + 1, line.length() - split_index - 1));
+static constexpr uint32_t KEY_SEED = FindKeySeed();
 
-			ParseSingleConfigOption(key, val);
-		}
-		else
+// Index of the option plus one, or 0 for an empty slot.
+static constexpr std::array<uint8_t, KEY_TABLE_SIZE> BuildKeyTable()
+{
+	static_assert(OPTIONS.size() < UINT8_MAX, "Too many options for the key table.");
+
+	std::array<uint8_t, KEY_TABLE_SIZE> table = { };
+	for (std::size_t i = 0; i < OPTIONS.size(); i++)
+	{
+		table[HashKey(OPTIONS[i].prefix, OPTIONS[i].name, KEY_SEED) % KEY_TABLE_SIZE] = static_cast<uint8_t>(i + 1);
+		if (!OPTIONS[i].alias.empty())
 		{
-			Log::OutputMessage(L"Invalid line in configuration file: " + line);
+			table[HashKey(OPTIONS[i].prefix, OPTIONS[i].alias, KEY_SEED) % KEY_TABLE_SIZE] = static_cast<uint8_t>(i + 1);
 		}
 	}
+
+	return table;
+}
+
+static constexpr std::array<uint8_t, KEY_TABLE_SIZE> KEY_TABLE = BuildKeyTable();
+
+static bool KeyEquals(std::wstring_view key, std::wstring_view prefix, std::wstring_view name)
+{
+	return key.length() == prefix.length() + name.length() && key.substr(0, prefix.length()) == prefix && key.substr(prefix.length()) == name;
 }
 
-void Config::Save(const std::wstring &file)
-{
-	std::lock_guard guard(m_ConfigLock);
-
-	std::wofstream configstream(file);
-
-	configstream << L"accent=" << std::left << std::setw(6) << std::setfill(L' ') << GetAccentText(REGULAR_APPEARANCE.ACCENT) << L"; accent values are: clear (default), fluent (only on build " << MIN_FLUENT_BUILD << L" and up), opaque, normal, or blur." << std::endl;
-	configstream << L"color=" << GetColorText(REGULAR_APPEARANCE.COLOR) << L" ; A color in hexadecimal notation." << std::endl;
-	configstream << L"opacity=" << GetOpacityText(REGULAR_APPEARANCE.COLOR) << L"  ; A value in the range 0 to 255." << std::endl;
-
-	configstream << std::endl;
-	configstream << L"; Dynamic Modes" << std::endl;
-	configstream << L"; they all have their own accent, color and opacity configs." << std::endl;
-	configstream << std::endl;
-	configstream << L"; Dynamic Windows. State to use when a window is maximised." << std::endl;
-	configstream << L"dynamic-ws=" << GetBoolText(MAXIMISED_ENABLED) << std::endl;
-	configstream << L"dynamic-ws-accent=" << GetAccentText(MAXIMISED_APPEARANCE.ACCENT) << std::endl;
-	configstream << L"dynamic-ws-color=" << GetColorText(MAXIMISED_APPEARANCE.COLOR) << L" ; A color in hexadecimal notation." << std::endl;
-	configstream << L"dynamic-ws-opacity=" << GetOpacityText(MAXIMISED_APPEARANCE.COLOR) << L"  ; A value in the range 0 to 255." << std::endl;
-	configstream << L"dynamic-ws-regular-on-peek=" << GetBoolText(MAXIMISED_REGULAR_ON_PEEK) << L" ; when using aero peek, behave as if no window was maximised." << std::endl;
-	configstream << std::endl;
-	configstream << L"; Dynamic Start. State to use when the start menu is opened." << std::endl;
-	configstream << L"dynamic-start=" << GetBoolText(START_ENABLED) << std::endl;
-	configstream << L"dynamic-start-accent=" << GetAccentText(START_APPEARANCE.ACCENT) << std::endl;
-	configstream << L"dynamic-start-color=" << GetColorText(START_APPEARANCE.COLOR) << L" ; A color in hexadecimal notation." << std::endl;
-	configstream << L"dynamic-start-opacity=" << GetOpacityText(START_APPEARANCE.COLOR) << L"  ; A value in the range 0 to 255." << std::endl;
-	configstream << std::endl;
-	configstream << L"; Dynamic Cortana. State to use when Cortana or the search menu is opened." << std::endl;
-	configstream << L"dynamic-cortana=" << GetBoolText(CORTANA_ENABLED) << std::endl;
-	configstream << L"dynamic-cortana-accent=" << GetAccentText(CORTANA_APPEARANCE.ACCENT) << std::endl;
-	configstream << L"dynamic-cortana-color=" << GetColorText(CORTANA_APPEARANCE.COLOR) << L" ; A color in hexadecimal notation." << std::endl;
-	configstream << L"dynamic-cortana-opacity=" << GetOpacityText(CORTANA_APPEARANCE.COLOR) << L"  ; A value in the range 0 to 255." << std::endl;
-	configstream << std::endl;
-	configstream << L"; Dynamic Timeline. State to use when the timeline (or task view on older builds) is opened." << std::endl;
-	configstream << L"dynamic-timeline=" << GetBoolText(TIMELINE_ENABLED) << std::endl;
-	configstream << L"dynamic-timeline-accent=" << GetAccentText(TIMELINE_APPEARANCE.ACCENT) << std::endl;
-	configstream << L"dynamic-timeline-color=" << GetColorText(TIMELINE_APPEARANCE.COLOR) << L" ; A color in hexadecimal notation." << std::endl;
-	configstream << L"dynamic-timeline-opacity=" << GetOpacityText(TIMELINE_APPEARANCE.COLOR) << L"  ; A value in the range 0 to 255." << std::endl;
-
-	configstream << std::endl;
-	configstream << L"; Controls how the Aero Peek button behaves (dynamic, show or hide)" << std::endl;
-	configstream << L"peek=";
-	switch (PEEK)
+// The key must already be lowercase.
+static const OPTION *FindOption(std::wstring_view key)
+{
+	const uint8_t entry = KEY_TABLE[HashKey(L"", key, KEY_SEED) % KEY_TABLE_SIZE];
+	if (entry != 0)
 	{
-	case PEEK::Disabled:
-		configstream << L"hide";
-		break;
-	case PEEK::Dynamic:
-		configstream << L"dynamic";
-		break;
-	case PEEK::Enabled:
-		configstream << L"show";
-		break;
+		const OPTION &option = OPTIONS[entry - 1];
+		if (KeyEquals(key, option.prefix, option.name) || (!option.alias.empty() && KeyEquals(key, option.prefix, option.alias)))
+		{
+			return &option;
+		}
 	}
-	configstream << std::endl;
-	configstream << L"peek-only-main=" << GetBoolText(PEEK_ONLY_MAIN) << L" ; Decides wether only the main monitor is considered when dynamic peek is enabled." << std::endl;
-
-	configstream << std::endl;
-	configstream << L"; Advanced settings" << std::endl;
-	configstream << L"; sleep time in milliseconds, a shorter time reduces flicker when opening start, but results in higher CPU usage." << std::endl;
-	configstream << L"sleep-time=" << std::dec << SLEEP_TIME << std::endl;
-	configstream << L"; hide icon in system tray. Changes to this requires a restart of the application." << std::endl;
-	configstream << L"no-tray=" << GetBoolText(NO_TRAY) << std::endl;
-	configstream << L"; more informative logging. Can make huge log files." << std::endl;
-	configstream << L"verbose=" << GetBoolText(VERBOSE) << std::endl;
+
+	return nullptr;
 }
 
-void Config::UnknownValue(const std::wstring &key, const std::wstring &value)
+// Longer keys can't be in the schema, so they are not worth lowercasing.
+static constexpr std::size_t MAX_KEY_LENGTH = 64;
+
+#pragma endregion
+
+#pragma region Encoding
+
+// Converts the content of a UTF-8 file to UTF-16. Pure ASCII files, by far the most common, never go through the system converter.
+static bool DecodeUtf8(const char *data, const std::size_t &length, std::wstring &result)
 {
-	Log::OutputMessage(L"Unknown value found in configuration file: " + value + L" (for key: " + key + L')');
+	if (length > INT_MAX)
+	{
+		SetLastError(ERROR_FILE_TOO_LARGE);
+		return false;
+	}
+
+	// UTF-16 never needs more code units than UTF-8 needs bytes.
+	result.resize(length);
+	const std::size_t ascii = Util::WidenAscii(data, length, result.data());
+	if (ascii != length)
+	{
+		const int remaining = static_cast<int>(length - ascii);
+		const int converted = MultiByteToWideChar(CP_UTF8, 0, data + ascii, remaining, result.data() + ascii, remaining);
+		if (converted == 0)
+		{
+			return false;
+		}
+
+		result.resize(ascii + converted);
+	}
+
+	return true;
 }
 
-bool Config::ParseAccent(const std::wstring &value, swca::ACCENT &accent)
+// Converts the text of a configuration file to UTF-8, with the CRLF line endings that text mode streams used to write.
+static bool EncodeConfigFile(std::wstring_view text, std::string &result)
 {
-	if (value == L"blur")
+	std::wstring crlf;
+	crlf.reserve(text.length() + text.length() / 16);
+	for (const wchar_t &character : text)
 	{
-		accent = swca::ACCENT::ACCENT_ENABLE_BLURBEHIND;
+		if (character == L'\n')
+		{
+			crlf += L'\r';
+		}
+
+		crlf += character;
 	}
-	else if (value == L"opaque")
+
+	if (crlf.length() > INT_MAX)
 	{
-		accent = swca::ACCENT::ACCENT_ENABLE_GRADIENT;
+		SetLastError(ERROR_FILE_TOO_LARGE);
+		return false;
 	}
-	else if (value == L"transparent" || value == L"translucent" || value == L"clear")
+
+	const int length = WideCharToMultiByte(CP_UTF8, 0, crlf.data(), static_cast<int>(crlf.length()), NULL, 0, NULL, NULL);
+	if (length == 0)
 	{
-		accent = swca::ACCENT::ACCENT_ENABLE_TRANSPARENTGRADIENT;
+		return crlf.empty();
 	}
-	else if (value == L"normal")
+
+	result.resize(length);
+	return WideCharToMultiByte(CP_UTF8, 0, crlf.data(), static_cast<int>(crlf.length()), result.data(), length, NULL, NULL) == length;
+}
+
+// Gets the text of a configuration file. Only UTF-16 LE files are viewed in place, anything else is converted to it.
+static bool DecodeConfigFile(const MappedFile &file, std::wstring &buffer, std::wstring_view &text)
+{
+	const uint8_t *data = file.data();
+	const std::size_t size = file.size();
+
+	if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE)
 	{
-		accent = swca::ACCENT::ACCENT_NORMAL;
+		// The view is page-aligned, so the characters after the BOM are correctly aligned.
+		text = { reinterpret_cast<const wchar_t *>(data + 2), (size - 2) / sizeof(wchar_t) };
+		return true;
 	}
-	else if (value == L"fluent" && win32::IsAtLeastBuild(MIN_FLUENT_BUILD))
+	else if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF)
 	{
-		accent = swca::ACCENT::ACCENT_ENABLE_FLUENT;
+		SetLastError(ERROR_UNSUPPORTED_TYPE);
+		return false;
 	}
 	else
 	{
-		return false;
+		const std::size_t bom = size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF ? 3 : 0;
+		if (!DecodeUtf8(reinterpret_cast<const char *>(data + bom), size - bom, buffer))
+		{
+			return false;
+		}
+
+		text = buffer;
+		return true;
 	}
+}
 
-	return true;
+#pragma endregion
+
+Config Config::Working;
+
+std::mutex Config::m_ConfigLock;
+std::condition_variable Config::m_ConfigChanged;
+std::shared_ptr<const Config> Config::m_Current = std::make_shared<const Config>();
+
+uint64_t Config::m_SavedTime;
+uint64_t Config::m_SavedHash;
+
+void Config::Publish()
+{
+	{
+		std::lock_guard guard(m_ConfigLock);
+		std::atomic_store(&m_Current, std::make_shared<const Config>(Working));
+	}
+
+	Log::set_verbose(Working.VERBOSE);
+	m_ConfigChanged.notify_all();
 }
 
-bool Config::ParseColor(std::wstring value, uint32_t &color)
+void Config::Parse(const std::wstring &file)
 {
-	Util::TrimInplace(value);
+	TraceScope("Config::Parse");
+	LARGE_INTEGER start;
+	QueryPerformanceCounter(&start);
 
-	Util::RemovePrefixInplace(value, L"#");
-	Util::RemovePrefixInplace(value, L"0x");
+	const bool from_snapshot = LoadSnapshot(file, Working);
+	if (!from_snapshot)
+	{
+		// Identify the source before parsing it, so that an edit made in the meantime makes the snapshot stale instead of wrong.
+		SNAPSHOT_HEADER header;
+		const bool has_source = GetSnapshotHeader(file, header, true);
 
-	// Get only the last 6 characters, keeps compatibility with old version.
-	// It stored AARRGGBB in color, but now we store it as RRGGBB.
-	// We read AA from opacity instead, which the old version also saved alpha to.
-	if (value.length() > 6)
+		Working = Load(file);
+		if (has_source)
+		{
+			SaveSnapshot(file, header, Working);
+		}
+	}
+
+	LARGE_INTEGER end, frequency;
+	QueryPerformanceCounter(&end);
+	QueryPerformanceFrequency(&frequency);
+
+	// After publishing, so that the verbose setting just loaded applies.
+	Publish();
+	LogMessage(Log::Level::Verbose, BinaryLog::MessageId::ConfigLoaded,
+		from_snapshot ? L"Loaded configuration snapshot" : L"Parsed configuration file",
+		(end.QuadPart - start.QuadPart) * 1000000 / frequency.QuadPart);
+}
+
+Config Config::Load(const std::wstring &file)
+{
+	Config config;
+
+	const MappedFile mapping(file);
+	if (!mapping)
 	{
-		value.erase(0, 2);
+		// Missing or empty, use the defaults.
+		return config;
 	}
 
-	try
+	std::wstring buffer;
+	std::wstring_view text;
+	if (!DecodeConfigFile(mapping, buffer, text))
 	{
-		color = (color & 0xFF000000) + (std::stoi(value, nullptr, 16) & 0x00FFFFFF);
+		LastErrorHandle(Error::Level::Log, L"Failed to decode configuration file.");
+		return config;
 	}
-	catch (std::invalid_argument)
+
+	while (!text.empty())
 	{
-		return false;
+		const size_t line_end = text.find(L'\n');
+		std::wstring_view line = text.substr(0, line_end);
+		text.remove_prefix(line_end != std::wstring_view::npos ? line_end + 1 : text.length());
+
+		if (!line.empty() && line.back() == L'\r')
+		{
+			line.remove_suffix(1);
+		}
+
+		// Skip comments
+		const size_t comment_index = line.find(L';');
+		if (comment_index != std::wstring_view::npos)
+		{
+			line.remove_suffix(line.length() - comment_index);
+		}
+
+		if (Util::Trim(line).empty())
+		{
+			continue;
+		}
+
+		const size_t split_index = line.find(L'=');
+		if (split_index != std::wstring_view::npos)
+		{
+			const std::wstring_view key = Util::Trim(line.substr(0, split_index));
+			const std::wstring_view val = Util::Trim(line.substr(split_index + 1));
+
+			config.ParseSingleConfigOption(key, val);
+		}
+		else
+		{
+			Log::Output(BinaryLog::MessageId::ConfigInvalidLine, line);
+		}
 	}
 
-	return true;
+	return config;
 }
 
-bool Config::ParseOpacity(const std::wstring &value, uint32_t &color)
+void Config::Save(const std::wstring &file) const
 {
-	try
+	// Build the whole file in memory, so that it can be compared and written at once.
+	std::wostringstream configstream;
+
+	for (const OPTION &option : OPTIONS)
+	{
+		configstream << option.header << option.prefix << option.name << L'=';
+
+		std::wstring value;
+		switch (option.type)
+		{
+		case OPTION_TYPE::Accent:
+			value = GetAccentText((this->*option.appearance).ACCENT);
+			break;
+		case OPTION_TYPE::Color:
+			value = GetColorText((this->*option.appearance).COLOR);
+			break;
+		case OPTION_TYPE::Opacity:
+			value = GetOpacityText((this->*option.appearance).COLOR);
+			break;
+		case OPTION_TYPE::Bool:
+			value = GetBoolText(this->*option.setting);
+			break;
+		case OPTION_TYPE::Peek:
+			value = GetPeekText(PEEK);
+			break;
+		case OPTION_TYPE::SleepTime:
+			value = std::to_wstring(SLEEP_TIME);
+			break;
+		case OPTION_TYPE::LogBudget:
+			value = std::to_wstring(LOG_BUDGET);
+			break;
+		}
+
+		if (!option.comment.empty())
+		{
+			std::wstring comment(option.comment);
+			if (const size_t token = comment.find(FLUENT_BUILD_TOKEN); token != std::wstring::npos)
+			{
+				comment.replace(token, FLUENT_BUILD_TOKEN.length(), std::to_wstring(MIN_FLUENT_BUILD));
+			}
+
+			configstream << std::left << std::setw(option.width) << std::setfill(L' ') << value << L" ; " << comment;
+		}
+		else
+		{
+			configstream << value;
+		}
+
+		configstream << L'\n';
+	}
+
+	std::string content;
+	if (!EncodeConfigFile(configstream.str(), content))
 	{
-		color = ((std::stoi(value) & 0xFF) << 24) + (color & 0x00FFFFFF);
-		return true;
+		LastErrorHandle(Error::Level::Log, L"Failed to encode configuration file.");
+		return;
 	}
-	catch (std::invalid_argument)
+
+	const uint64_t hash = Util::HashBytes(content.data(), content.size());
+
+	SNAPSHOT_HEADER header;
+	if (GetSnapshotHeader(file, header, false) && header.source_size == content.size())
 	{
-		Log::OutputMessage(L"Could not parse opacity found in configuration file: " + value);
-		return false;
+		// When the file is still the one we last wrote, we already know its hash.
+		const bool unchanged = header.source_time == m_SavedTime
+			? hash == m_SavedHash
+			: GetSnapshotHeader(file, header, true) && hash == header.source_hash;
+
+		if (unchanged)
+		{
+			LogMessage(Log::Level::Verbose, BinaryLog::MessageId::ConfigUpToDate);
+			return;
+		}
 	}
-}
 
-bool Config::ParseBool(const std::wstring &value, bool &setting)
-{
-	if (value == L"true" || value == L"enable")
+	if (!win32::WriteFileAtomically(file, content.data(), content.size()))
 	{
-		setting = true;
+		LastErrorHandle(Error::Level::Log, L"Failed to save configuration file.");
+		return;
 	}
-	else if (value == L"false" || value == L"disable")
+
+	if (GetSnapshotHeader(file, header, false))
 	{
-		setting = false;
+		header.source_hash = hash;
+		m_SavedTime = header.source_time;
+		m_SavedHash = hash;
+
+		SaveSnapshot(file, header, *this);
 	}
-	else
+}
+
+
+uint64_t Config::HashDefaults()
+{
+	static const uint64_t hash = []
+	{
+		// Constructed over zeroes, so that the padding hashes the same from one run to the next.
+		alignas(Config) uint8_t buffer[sizeof(Config)] = { };
+		const Config *defaults = new (buffer) Config;
+
+		return Util::HashBytes(defaults, sizeof(Config));
+	}();
+
+	return hash;
+}
+
+bool Config::GetSnapshotHeader(const std::wstring &file, SNAPSHOT_HEADER &header, const bool &hash)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesEx(file.c_str(), GetFileExInfoStandard, &attributes))
 	{
 		return false;
 	}
 
+	header = { };
+	header.magic = SNAPSHOT_MAGIC;
+	header.version = SNAPSHOT_VERSION;
+	header.config_size = sizeof(Config);
+	header.fluent = win32::IsAtLeastBuild(MIN_FLUENT_BUILD);
+	header.defaults_hash = HashDefaults();
+	header.source_size = (static_cast<uint64_t>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+	header.source_time = (static_cast<uint64_t>(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+	header.source_hash = Util::HashBytes(nullptr, 0);
+
+	if (hash && header.source_size != 0)
+	{
+		const MappedFile source(file);
+		if (!source || source.size() != header.source_size)
+		{
+			return false;
+		}
+
+		header.source_hash = Util::HashBytes(source.data(), source.size());
+	}
+
 	return true;
 }
 
-void Config::ParseSingleConfigOption(const std::wstring &arg, const std::wstring &value)
+bool Config::LoadSnapshot(const std::wstring &file, Config &config)
 {
-	if (arg == L"accent")
+	static_assert(std::is_trivially_copyable_v<Config>, "Config must be trivially copyable to be snapshotted.");
+
+	SNAPSHOT_HEADER current;
+	if (!GetSnapshotHeader(file, current, false))
 	{
-		if (!ParseAccent(value, REGULAR_APPEARANCE.ACCENT))
-		{
-			UnknownValue(arg, value);
-		}
+		return false;
 	}
-	else if (arg == L"color" || arg == L"tint")
+
+	const std::wstring snapshot_file = file + CACHE_EXTENSION;
+	uint8_t buffer[sizeof(SNAPSHOT_HEADER) + sizeof(Config) + 1];
+	DWORD bytesRead;
 	{
-		if (!ParseColor(value, REGULAR_APPEARANCE.COLOR))
+		const winrt::file_handle handle(CreateFile(snapshot_file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+
+		// Ask for one byte too many to catch snapshots of the wrong size.
+		if (!handle || !ReadFile(handle.get(), buffer, sizeof(buffer), &bytesRead, NULL) || bytesRead != sizeof(buffer) - 1)
 		{
-			Log::OutputMessage(L"Could not parse color found in configuration file: " + value);
+			return false;
 		}
 	}
-	else if (arg == L"opacity")
+
+	SNAPSHOT_HEADER header;
+	std::memcpy(&header, buffer, sizeof(header));
+	if (header.magic != current.magic || header.version != current.version || header.config_size != current.config_size ||
+		header.fluent != current.fluent || header.defaults_hash != current.defaults_hash || header.source_size != current.source_size ||
+		header.config_hash != Util::HashBytes(buffer + sizeof(header), sizeof(Config)))
 	{
-		if (!ParseOpacity(value, REGULAR_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse opacity found in configuration file: " + value);
-		}
+		return false;
 	}
-	else if (arg == L"dynamic-ws")
+
+	if (header.source_time != current.source_time)
 	{
-		if (!ParseBool(value, MAXIMISED_ENABLED))
+		// The file was written to, but maybe with the same content.
+		if (!GetSnapshotHeader(file, current, true) || header.source_hash != current.source_hash)
 		{
-			UnknownValue(arg, value);
+			return false;
 		}
 	}
-	else if (arg == L"dynamic-ws-accent")
+
+	std::memcpy(&config, buffer + sizeof(header), sizeof(Config));
+	if (header.source_time != current.source_time)
 	{
-		if (!ParseAccent(value, MAXIMISED_APPEARANCE.ACCENT))
-		{
-			UnknownValue(arg, value);
-		}
+		SaveSnapshot(file, current, config);
 	}
-	else if (arg == L"dynamic-ws-color" || arg == L"dynamic-ws-tint")
+
+	return true;
+}
+
+void Config::SaveSnapshot(const std::wstring &file, SNAPSHOT_HEADER header, const Config &config)
+{
+	uint8_t buffer[sizeof(SNAPSHOT_HEADER) + sizeof(Config)];
+	std::memcpy(buffer + sizeof(header), &config, sizeof(Config));
+	header.config_hash = Util::HashBytes(buffer + sizeof(header), sizeof(Config));
+	std::memcpy(buffer, &header, sizeof(header));
+
+	if (!win32::WriteFileAtomically(file + CACHE_EXTENSION, buffer, sizeof(buffer)))
 	{
-		if (!ParseColor(value, MAXIMISED_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic windows color found in configuration file: " + value);
-		}
+		LastErrorHandle(Error::Level::Log, L"Failed to write configuration snapshot.");
 	}
-	else if (arg == L"dynamic-ws-opacity")
+}
+
+void Config::UnknownValue(std::wstring_view key, std::wstring_view value)
+{
+	Log::Output(BinaryLog::MessageId::ConfigUnknownValue, value, key);
+}
+
+bool Config::ParseAccent(std::wstring_view value, swca::ACCENT &accent)
+{
+	if (Util::IgnoreCaseStringEquals(value, L"blur"))
 	{
-		if (!ParseOpacity(value, MAXIMISED_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic windows opacity found in configuration file: " + value);
-		}
+		accent = swca::ACCENT::ACCENT_ENABLE_BLURBEHIND;
 	}
-	else if (arg == L"dynamic-ws-regular-on-peek")
+	else if (Util::IgnoreCaseStringEquals(value, L"opaque"))
 	{
-		if (!ParseBool(value, MAXIMISED_REGULAR_ON_PEEK))
-		{
-			UnknownValue(arg, value);
-		}
+		accent = swca::ACCENT::ACCENT_ENABLE_GRADIENT;
 	}
-	else if (arg == L"dynamic-start")
+	else if (Util::IgnoreCaseStringEquals(value, L"transparent") || Util::IgnoreCaseStringEquals(value, L"translucent") || Util::IgnoreCaseStringEquals(value, L"clear"))
 	{
-		if (!ParseBool(value, START_ENABLED))
-		{
-			UnknownValue(arg, value);
-		}
+		accent = swca::ACCENT::ACCENT_ENABLE_TRANSPARENTGRADIENT;
 	}
-	else if (arg == L"dynamic-start-accent")
+	else if (Util::IgnoreCaseStringEquals(value, L"normal"))
 	{
-		if (!ParseAccent(value, START_APPEARANCE.ACCENT))
-		{
-			UnknownValue(arg, value);
-		}
+		accent = swca::ACCENT::ACCENT_NORMAL;
 	}
-	else if (arg == L"dynamic-start-color" || arg == L"dynamic-start-tint")
+	else if (Util::IgnoreCaseStringEquals(value, L"fluent") && win32::IsAtLeastBuild(MIN_FLUENT_BUILD))
 	{
-		if (!ParseColor(value, START_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic start color found in configuration file: " + value);
-		}
+		accent = swca::ACCENT::ACCENT_ENABLE_FLUENT;
 	}
-	else if (arg == L"dynamic-start-opacity")
+	else
 	{
-		if (!ParseOpacity(value, START_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic start opacity found in configuration file: " + value);
-		}
+		return false;
 	}
-	else if (arg == L"dynamic-cortana")
+
+	return true;
+}
+
+bool Config::ParseColor(std::wstring_view value, uint32_t &color)
+{
+	if (!value.empty() && value.front() == L'#')
 	{
-		if (!ParseBool(value, CORTANA_ENABLED))
-		{
-			UnknownValue(arg, value);
-		}
+		value.remove_prefix(1);
 	}
-	else if (arg == L"dynamic-cortana-accent")
+
+	if (value.length() >= 2 && value[0] == L'0' && (value[1] == L'x' || value[1] == L'X'))
 	{
-		if (!ParseAccent(value, CORTANA_APPEARANCE.ACCENT))
-		{
-			UnknownValue(arg, value);
-		}
+		value.remove_prefix(2);
 	}
-	else if (arg == L"dynamic-cortana-color" || arg == L"dynamic-cortana-tint")
+
+	// Get only the last 6 characters, keeps compatibility with old version.
+	// It stored AARRGGBB in color, but now we store it as RRGGBB.
+	// We read AA from opacity instead, which the old version also saved alpha to.
+	if (value.length() > 6)
 	{
-		if (!ParseColor(value, CORTANA_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic Cortana color found in configuration file: " + value);
-		}
+		value.remove_prefix(2);
 	}
-	else if (arg == L"dynamic-cortana-opacity")
+
+	uint32_t rgb;
+	if (!Util::ParseInteger(value, rgb, 16))
 	{
-		if (!ParseOpacity(value, CORTANA_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic Cortana opacity found in configuration file: " + value);
-		}
+		return false;
 	}
-	else if (arg == L"dynamic-timeline")
+
+	color = (color & 0xFF000000) + (rgb & 0x00FFFFFF);
+	return true;
+}
+
+bool Config::ParseOpacity(std::wstring_view value, uint32_t &color)
+{
+	int opacity;
+	if (!Util::ParseInteger(value, opacity))
 	{
-		if (!ParseBool(value, TIMELINE_ENABLED))
-		{
-			UnknownValue(arg, value);
-		}
+		return false;
 	}
-	else if (arg == L"dynamic-timeline-accent")
+
+	color = ((opacity & 0xFF) << 24) + (color & 0x00FFFFFF);
+	return true;
+}
+
+bool Config::ParseBool(std::wstring_view value, bool &setting)
+{
+	if (Util::IgnoreCaseStringEquals(value, L"true") || Util::IgnoreCaseStringEquals(value, L"enable"))
 	{
-		if (!ParseAccent(value, TIMELINE_APPEARANCE.ACCENT))
-		{
-			UnknownValue(arg, value);
-		}
+		setting = true;
 	}
-	else if (arg == L"dynamic-timeline-color" || arg == L"dynamic-timeline-tint")
+	else if (Util::IgnoreCaseStringEquals(value, L"false") || Util::IgnoreCaseStringEquals(value, L"disable"))
 	{
-		if (!ParseColor(value, TIMELINE_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic timeline color found in configuration file: " + value);
-		}
+		setting = false;
 	}
-	else if (arg == L"dynamic-timeline-opacity")
+	else
 	{
-		if (!ParseOpacity(value, TIMELINE_APPEARANCE.COLOR))
-		{
-			Log::OutputMessage(L"Could not parse dynamic timeline opacity found in configuration file: " + value);
-		}
+		return false;
 	}
-	else if (arg == L"peek")
+
+	return true;
+}
+
+bool Config::ParsePeek(std::wstring_view value, enum PEEK &peek)
+{
+	if (Util::IgnoreCaseStringEquals(value, L"hide"))
 	{
-		if (value == L"hide")
+		peek = PEEK::Disabled;
+	}
+	else if (Util::IgnoreCaseStringEquals(value, L"dynamic"))
+	{
+		peek = PEEK::Dynamic;
+	}
+	else if (Util::IgnoreCaseStringEquals(value, L"show"))
+	{
+		peek = PEEK::Enabled;
+	}
+	else
+	{
+		return false;
+	}
+
+	return true;
+}
+
+void Config::ParseSingleConfigOption(std::wstring_view arg, std::wstring_view value)
+{
+	const OPTION *option = nullptr;
+	if (arg.length() <= MAX_KEY_LENGTH)
+	{
+		wchar_t key[MAX_KEY_LENGTH];
+		std::copy(arg.begin(), arg.end(), key);
+		Util::ToLowerInplace(key, arg.length());
+
+		option = FindOption({ key, arg.length() });
+	}
+
+	if (!option)
+	{
+		Log::Output(BinaryLog::MessageId::ConfigUnknownKey, arg);
+		return;
+	}
+
+	switch (option->type)
+	{
+	case OPTION_TYPE::Accent:
+		if (!ParseAccent(value, (this->*option->appearance).ACCENT))
 		{
-			PEEK = PEEK::Disabled;
+			UnknownValue(arg, value);
 		}
-		else if (value == L"dynamic")
+		break;
+	case OPTION_TYPE::Color:
+		if (!ParseColor(value, (this->*option->appearance).COLOR))
 		{
-			PEEK = PEEK::Dynamic;
+			Log::Output(BinaryLog::MessageId::ConfigInvalidValue, L"color", value, arg);
 		}
-		else if (value == L"show")
+		break;
+	case OPTION_TYPE::Opacity:
+		if (!ParseOpacity(value, (this->*option->appearance).COLOR))
 		{
-			PEEK = PEEK::Enabled;
+			Log::Output(BinaryLog::MessageId::ConfigInvalidValue, L"opacity", value, arg);
 		}
-		else
+		break;
+	case OPTION_TYPE::Bool:
+		if (!ParseBool(value, this->*option->setting))
 		{
 			UnknownValue(arg, value);
 		}
-	}
-	else if (arg == L"peek-only-main")
-	{
-		if (!ParseBool(value, PEEK_ONLY_MAIN))
+		break;
+	case OPTION_TYPE::Peek:
+		if (!ParsePeek(value, PEEK))
 		{
 			UnknownValue(arg, value);
 		}
-	}
-	else if (arg == L"sleep-time")
-	{
-		try
+		break;
+	case OPTION_TYPE::SleepTime:
+		if (int sleep_time; Util::ParseInteger(value, sleep_time))
 		{
-			SLEEP_TIME = std::stoi(value) & 0xFF;
+			SLEEP_TIME = sleep_time & 0xFF;
 		}
-		catch (std::invalid_argument)
+		else
 		{
-			Log::OutputMessage(L"Could not parse sleep time found in configuration file: " + value);
+			Log::Output(BinaryLog::MessageId::ConfigInvalidValue, L"sleep time", value, arg);
 		}
-	}
-	else if (arg == L"no-tray")
-	{
-		if (!ParseBool(value, NO_TRAY))
+		break;
+	case OPTION_TYPE::LogBudget:
+		if (uint16_t log_budget; Util::ParseInteger(value, log_budget) && log_budget != 0)
 		{
-			UnknownValue(arg, value);
+			LOG_BUDGET = log_budget;
 		}
-	}
-	else if (arg == L"verbose")
-	{
-		if (!ParseBool(value, VERBOSE))
+		else
 		{
-			UnknownValue(arg, value);
+			Log::Output(BinaryLog::MessageId::ConfigInvalidValue, L"log budget", value, arg);
 		}
-	}
-	else
-	{
-		Log::OutputMessage(L"Unknown key found in configuration file: " + arg);
+		break;
 	}
 }
 
@@ -473,9 +844,22 @@ std::wstring Config::GetColorText(const uint32_t &color)
 
 std::wstring Config::GetOpacityText(const uint32_t &color)
 {
-	std::wostringstream stream;
-	stream << std::left << std::setw(3) << std::setfill(L' ') << std::dec << ((color & 0xFF000000) >> 24);
-	return stream.str();
+	return std::to_wstring((color & 0xFF000000) >> 24);
+}
+
+std::wstring Config::GetPeekText(const enum PEEK &peek)
+{
+	switch (peek)
+	{
+	case PEEK::Disabled:
+		return L"hide";
+	case PEEK::Dynamic:
+		return L"dynamic";
+	case PEEK::Enabled:
+		return L"show";
+	default:
+		throw std::invalid_argument("peek was not one of the known values");
+	}
 }
 
 std::wstring Config::GetBoolText(const bool &value)
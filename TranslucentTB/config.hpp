@@ -1,7 +1,11 @@
 #pragma once
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
 
 #include "swcadata.hpp"
 
@@ -14,53 +18,124 @@ public:
 	};
 
 	// Regular
-	static TASKBAR_APPEARANCE REGULAR_APPEARANCE;
+	TASKBAR_APPEARANCE REGULAR_APPEARANCE = { swca::ACCENT::ACCENT_ENABLE_TRANSPARENTGRADIENT, 0x0 };
 
 	// Maximised
-	static bool MAXIMISED_ENABLED;
-	static TASKBAR_APPEARANCE MAXIMISED_APPEARANCE;
-	static bool MAXIMISED_REGULAR_ON_PEEK;
+	bool MAXIMISED_ENABLED = true;
+	TASKBAR_APPEARANCE MAXIMISED_APPEARANCE = { swca::ACCENT::ACCENT_ENABLE_BLURBEHIND, 0xaa000000 };
+	bool MAXIMISED_REGULAR_ON_PEEK = true;
 
 	// Start menu
-	static bool START_ENABLED;
-	static TASKBAR_APPEARANCE START_APPEARANCE;
+	bool START_ENABLED = true;
+	TASKBAR_APPEARANCE START_APPEARANCE = { swca::ACCENT::ACCENT_NORMAL, 0x0 };
 
 	// Cortana
-	static bool CORTANA_ENABLED;
-	static TASKBAR_APPEARANCE CORTANA_APPEARANCE;
+	bool CORTANA_ENABLED = true;
+	TASKBAR_APPEARANCE CORTANA_APPEARANCE = { swca::ACCENT::ACCENT_NORMAL, 0x0 };
 
 	// Timeline/Task View
-	static bool TIMELINE_ENABLED;
-	static TASKBAR_APPEARANCE TIMELINE_APPEARANCE;
+	bool TIMELINE_ENABLED = true;
+	TASKBAR_APPEARANCE TIMELINE_APPEARANCE = { swca::ACCENT::ACCENT_NORMAL, 0x0 };
 
 	// Peek
-	static enum /*class*/ PEEK {
+	enum /*class*/ PEEK {
 		Disabled, // Hide the button
 		Dynamic,  // Show when a window is maximised
 		Enabled   // Don't hide the button
-	} PEEK;
-	static bool PEEK_ONLY_MAIN;
+	} PEEK = PEEK::Dynamic;
+	bool PEEK_ONLY_MAIN = true;
 
 	// Advanced
-	static uint8_t SLEEP_TIME;
-	static bool NO_TRAY;
-	static bool VERBOSE;
+	uint8_t SLEEP_TIME = 10;
+	bool NO_TRAY = false;
+	bool VERBOSE =
+#ifndef _DEBUG
+		false;
+#else
+		true;
+#endif
+	bool BINARY_LOG = false;
+	uint16_t LOG_BUDGET = 16;
 
+	// The configuration edited by the tray and the settings files.
+	// Only touch it from the main thread, and publish it once done.
+	static Config Working;
+
+	// Makes a copy of the working configuration visible to every thread.
+	static void Publish();
+
+	// Gets the last published configuration. It never changes, hold onto it for as long as a consistent view is needed.
+	inline static std::shared_ptr<const Config> Current()
+	{
+		return std::atomic_load(&m_Current);
+	}
+
+	// Blocks until a configuration other than the one given gets published, or the timeout expires.
+	template<class Rep, class Period>
+	inline static void WaitForChange(const std::shared_ptr<const Config> &seen, const std::chrono::duration<Rep, Period> &timeout)
+	{
+		std::unique_lock guard(m_ConfigLock);
+		m_ConfigChanged.wait_for(guard, timeout, [&seen]
+		{
+			return std::atomic_load(&m_Current) != seen;
+		});
+	}
+
+	// Loads the working configuration from a file and publishes it. Main thread only.
+	// Uses the snapshot stored next to the file when it is up to date, and refreshes it otherwise.
 	static void Parse(const std::wstring &file);
-	static void Save(const std::wstring &file);
+
+	// Reads a configuration from a file. Touches nothing else, so safe to call from any thread.
+	static Config Load(const std::wstring &file);
+
+	// Reads the snapshot stored next to a file instead of parsing it. Returns false when the snapshot
+	// is missing or doesn't match the file. Rewrites it when the file was only touched. Main thread only.
+	static bool LoadSnapshot(const std::wstring &file, Config &config);
+
+	// Writes the file atomically, and only if its content changed. Also refreshes the snapshot,
+	// so that the next start doesn't need to parse the file. Main thread only.
+	void Save(const std::wstring &file) const;
 
 private:
 	static std::mutex m_ConfigLock;
+	static std::condition_variable m_ConfigChanged;
+	static std::shared_ptr<const Config> m_Current;
+
+	// A snapshot is this header followed by a raw copy of a parsed configuration.
+	struct SNAPSHOT_HEADER {
+		uint32_t magic;
+		uint32_t version;
+		uint32_t config_size;	// Catches layout changes between builds
+		uint32_t fluent;		// Parsing depends on whether fluent is available
+		uint64_t source_size;
+		uint64_t source_time;	// Last write time. When it matches, the source isn't hashed.
+		uint64_t source_hash;
+		uint64_t config_hash;
+		uint64_t defaults_hash;	// The snapshot includes defaults, so a build changing them can't use it
+	};
+
+	static constexpr uint32_t SNAPSHOT_MAGIC = 0x43425454; // TTBC
+	static constexpr uint32_t SNAPSHOT_VERSION = 4;	// Bump when fields are added to Config, padding can hide them from config_size
+
+	// Last write time and hash of the file as Save last wrote it.
+	static uint64_t m_SavedTime;
+	static uint64_t m_SavedHash;
+
+	static uint64_t HashDefaults();
+	static bool GetSnapshotHeader(const std::wstring &file, SNAPSHOT_HEADER &header, const bool &hash);
+	static void SaveSnapshot(const std::wstring &file, SNAPSHOT_HEADER header, const Config &config);
 
-	static void UnknownValue(const std::wstring &key, const std::wstring &value);
-	static bool ParseAccent(const std::wstring &value, swca::ACCENT &accent);
-	static bool ParseColor(std::wstring value, uint32_t &color);
-	static bool ParseOpacity(const std::wstring &value, uint32_t &color);
-	static bool ParseBool(const std::wstring &value, bool &setting);
-	static void ParseSingleConfigOption(const std::wstring &arg, const std::wstring &value);
+	static void UnknownValue(std::wstring_view key, std::wstring_view value);
+	static bool ParseAccent(std::wstring_view value, swca::ACCENT &accent);
+	static bool ParseColor(std::wstring_view value, uint32_t &color);
+	static bool ParseOpacity(std::wstring_view value, uint32_t &color);
+	static bool ParseBool(std::wstring_view value, bool &setting);
+	static bool ParsePeek(std::wstring_view value, enum PEEK &peek);
+	void ParseSingleConfigOption(std::wstring_view arg, std::wstring_view value);
 
 	static std::wstring GetAccentText(const swca::ACCENT &accent);
 	static std::wstring GetColorText(const uint32_t &color);
 	static std::wstring GetOpacityText(const uint32_t &color);
 	static std::wstring GetBoolText(const bool &value);
+	static std::wstring GetPeekText(const enum PEEK &peek);
 };
\ No newline at end of file
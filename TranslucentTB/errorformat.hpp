@@ -0,0 +1,30 @@
+#pragma once
+#include "arch.h"
+#include <cstdint>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <WinBase.h>
+#include <winnt.h>
+
+#include "util.hpp"
+
+// Turns an HRESULT into the text written to logs.
+// Shared with the LogDecoder tool, so decoded binary logs read the same as text logs.
+class ErrorFormat {
+
+public:
+	inline static std::wstring FromHRESULT(const int32_t &result)
+	{
+		wchar_t *error = nullptr;
+		const DWORD count = FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS | FORMAT_MESSAGE_MAX_WIDTH_MASK, nullptr, static_cast<DWORD>(result), MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US), reinterpret_cast<wchar_t *>(&error), 0, nullptr);
+
+		std::wostringstream stream;
+		stream << L"Exception from HRESULT: " << (count ? Util::Trim(std::wstring_view(error)) : L"[failed to get error message for HRESULT]") <<
+			L" (0x" << std::setw(sizeof(int32_t) * 2) << std::setfill(L'0') << std::hex << result << L')';
+
+		LocalFree(error);
+		return stream.str();
+	}
+};
\ No newline at end of file
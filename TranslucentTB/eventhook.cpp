@@ -1,21 +1,65 @@
 #include "eventhook.hpp"
 
+#include "metrics.hpp"
+#include "tracing.hpp"
 #include "ttblog.hpp"
 
-void CALLBACK EventHook::RawHookCallback(HWINEVENTHOOK hook, DWORD event, HWND window, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime)
+std::mutex EventHook::m_SlotsLock;
+EventHook::SLOT EventHook::m_Slots[MAX_HOOKS];
+
+template<std::size_t slot>
+void CALLBACK EventHook::SlotCallback(HWINEVENTHOOK, DWORD event, HWND window, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime)
+{
+	TraceScope("EventHook::SlotCallback");
+	Metrics::Increment(Metrics::Counter::HookEvents);
+
+	// Out of context events are delivered on the thread that created the hook, which is also the only one changing its slot.
+	// Events queued before the hook was removed can still arrive, once the slot is empty.
+	if (const callback_t &callback = m_Slots[slot].callback)
+	{
+		callback(event, window, idObject, idChild, dwEventThread, dwmsEventTime);
+	}
+}
+
+template<std::size_t... slots>
+constexpr auto EventHook::MakeSlotCallbacks(std::index_sequence<slots...>)
 {
-	GetMap()[hook](event, window, idObject, idChild, dwEventThread, dwmsEventTime);
+	return std::array<WINEVENTPROC, sizeof...(slots)> { &SlotCallback<slots>... };
 }
 
-EventHook::EventHook(const DWORD &min, const DWORD &max, const callback_t &callback, const DWORD &flags, const HMODULE &hMod, const DWORD &idProcess, const DWORD &idThread)
+const std::array<WINEVENTPROC, EventHook::MAX_HOOKS> EventHook::m_SlotCallbacks = MakeSlotCallbacks(std::make_index_sequence<MAX_HOOKS>());
+
+EventHook::EventHook(const DWORD &min, const DWORD &max, callback_t callback, const DWORD &flags, const HMODULE &hMod, const DWORD &idProcess, const DWORD &idThread) :
+	m_Handle(nullptr),
+	m_Slot(MAX_HOOKS)
 {
-	m_Handle = SetWinEventHook(min, max, hMod, RawHookCallback, idProcess, idThread, flags);
+	std::lock_guard guard(m_SlotsLock);
+	for (std::size_t i = 0; i < MAX_HOOKS; i++)
+	{
+		if (!m_Slots[i].used)
+		{
+			m_Slot = i;
+			break;
+		}
+	}
+
+	if (m_Slot == MAX_HOOKS)
+	{
+		Log::OutputMessage(L"Failed to create a Windows event hook: too many hooks.");
+		return;
+	}
+
+	SLOT &slot = m_Slots[m_Slot];
+	slot.callback = std::move(callback);
+	m_Handle = SetWinEventHook(min, max, hMod, m_SlotCallbacks[m_Slot], idProcess, idThread, flags);
 	if (m_Handle)
 	{
-		GetMap().emplace(m_Handle, callback);
+		slot.used = true;
 	}
 	else
 	{
+		slot.callback = { };
+		m_Slot = MAX_HOOKS;
 		Log::OutputMessage(L"Failed to create a Windows event hook.");
 	}
 }
@@ -24,10 +68,16 @@ EventHook::~EventHook()
 {
 	if (m_Handle)
 	{
-		GetMap().erase(m_Handle);
 		if (!UnhookWinEvent(m_Handle))
 		{
 			Log::OutputMessage(L"Failed to delete a Windows event hook.");
 		}
 	}
+
+	if (m_Slot != MAX_HOOKS)
+	{
+		std::lock_guard guard(m_SlotsLock);
+		m_Slots[m_Slot].callback = { };
+		m_Slots[m_Slot].used = false;
+	}
 }
\ No newline at end of file
@@ -1,30 +1,45 @@
 #pragma once
 #include "arch.h"
-#include <functional>
-#include <unordered_map>
+#include <array>
+#include <cstddef>
+#include <mutex>
+#include <utility>
 #include <windef.h>
 #include <WinUser.h>
 
+#include "smallfunction.hpp"
 #include "window.hpp"
 
 class EventHook {
 
 private:
-	using callback_t = std::function<void(DWORD, const Window &, LONG, LONG, DWORD, DWORD)>;
+	using callback_t = SmallFunction<void(DWORD, const Window &, LONG, LONG, DWORD, DWORD)>;
+
+	// Each hook gets a slot and a callback of its own that knows it, because WinEvent callbacks get no context.
+	static constexpr std::size_t MAX_HOOKS = 16;
+
+	struct SLOT {
+		bool used = false;
+		callback_t callback;
+	};
+
+	// Constant initialized, so hooks with static storage duration can use them.
+	static std::mutex m_SlotsLock;
+	static SLOT m_Slots[MAX_HOOKS];
+	static const std::array<WINEVENTPROC, MAX_HOOKS> m_SlotCallbacks;
+
 	HWINEVENTHOOK m_Handle;
+	std::size_t m_Slot;
 
-	// As function because static initialization order.
-	inline static std::unordered_map<HWINEVENTHOOK, callback_t> &GetMap()
-	{
-		static std::unordered_map<HWINEVENTHOOK, callback_t> map;
-		return map;
-	}
+	template<std::size_t slot>
+	static void CALLBACK SlotCallback(HWINEVENTHOOK hook, DWORD event, HWND window, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime);
 
-	static void CALLBACK RawHookCallback(HWINEVENTHOOK hook, DWORD event, HWND window, LONG idObject, LONG idChild, DWORD dwEventThread, DWORD dwmsEventTime);
+	template<std::size_t... slots>
+	static constexpr auto MakeSlotCallbacks(std::index_sequence<slots...>);
 
 public:
-	inline EventHook(const HWINEVENTHOOK &handle) : m_Handle(handle) { }
-	EventHook(const DWORD &min, const DWORD &max, const callback_t &callback, const DWORD &flags, const HMODULE &hMod = NULL, const DWORD &idProcess = 0, const DWORD &idThread = 0);
+	inline EventHook(const HWINEVENTHOOK &handle) : m_Handle(handle), m_Slot(MAX_HOOKS) { }
+	EventHook(const DWORD &min, const DWORD &max, callback_t callback, const DWORD &flags, const HMODULE &hMod = NULL, const DWORD &idProcess = 0, const DWORD &idThread = 0);
 
 	inline EventHook(const EventHook &) = delete;
 	inline EventHook &operator =(const EventHook &) = delete;
@@ -0,0 +1,35 @@
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature>
+class FunctionRef;
+
+// A non owning reference to a callable, for callbacks that are only called before the function taking them returns.
+// Costs two pointers and never allocates, but the callable must outlive the FunctionRef.
+template<typename R, typename... Args>
+class FunctionRef<R(Args...)> {
+
+private:
+	void *m_Object;
+	R (*m_Invoke)(void *object, Args... args);
+
+	template<typename T>
+	inline static R Invoke(void *object, Args... args)
+	{
+		return (*static_cast<T *>(object))(std::forward<Args>(args)...);
+	}
+
+public:
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, FunctionRef> && std::is_invocable_r_v<R, F &, Args...>>>
+	inline FunctionRef(F &&callable) noexcept :
+		m_Object(const_cast<void *>(static_cast<const void *>(std::addressof(callable)))),
+		m_Invoke(&Invoke<std::remove_reference_t<F>>)
+	{ }
+
+	inline R operator ()(Args... args) const
+	{
+		return m_Invoke(m_Object, std::forward<Args>(args)...);
+	}
+};
\ No newline at end of file
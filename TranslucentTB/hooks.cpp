@@ -4,7 +4,7 @@
 EventHook Hooks::m_ChangeHook(EVENT_OBJECT_NAMECHANGE, EVENT_OBJECT_NAMECHANGE, Hooks::HandleChangeEvent, WINEVENT_OUTOFCONTEXT);
 EventHook Hooks::m_DestroyHook(EVENT_OBJECT_DESTROY, EVENT_OBJECT_DESTROY, Hooks::HandleDestroyEvent, WINEVENT_OUTOFCONTEXT);
 
-void Hooks::HandleChangeEvent(const DWORD, const Window &window, ...)
+void Hooks::HandleChangeEvent(const DWORD, const Window &window, LONG, LONG, DWORD, DWORD)
 {
 	{
 		std::lock_guard guard(Blacklist::m_CacheLock);
@@ -17,7 +17,7 @@ void Hooks::HandleChangeEvent(const DWORD, const Window &window, ...)
 	}
 }
 
-void Hooks::HandleDestroyEvent(const DWORD, const Window &window, ...)
+void Hooks::HandleDestroyEvent(const DWORD, const Window &window, LONG, LONG, DWORD, DWORD)
 {
 	{
 		std::lock_guard guard(Blacklist::m_CacheLock);
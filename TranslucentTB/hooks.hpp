@@ -7,6 +7,6 @@ private:
 	static EventHook m_ChangeHook;
 	static EventHook m_DestroyHook;
 
-	static void HandleChangeEvent(const DWORD, const Window &window, ...);
-	static void HandleDestroyEvent(const DWORD, const Window &window, ...);
+	static void HandleChangeEvent(const DWORD, const Window &window, LONG, LONG, DWORD, DWORD);
+	static void HandleDestroyEvent(const DWORD, const Window &window, LONG, LONG, DWORD, DWORD);
 };
\ No newline at end of file
@@ -1,7 +1,11 @@
 // Standard API
 #include <chrono>
+#include <ctime>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <unordered_map>
 
@@ -20,8 +24,11 @@
 #include "createinstance.hpp"
 #include "eventhook.hpp"
 #include "messagewindow.hpp"
+#include "metrics.hpp"
 #include "resource.h"
 #include "swcadata.hpp"
+#include "tickschedule.hpp"
+#include "tracing.hpp"
 #include "traycontextmenu.hpp"
 #include "ttberror.hpp"
 #include "ttblog.hpp"
@@ -44,7 +51,7 @@ enum class EXITREASON {
 static struct {
 	EXITREASON exit_reason = EXITREASON::UserAction;
 	Window main_taskbar;
-	std::unordered_map<HMONITOR, std::pair<Window, const Config::TASKBAR_APPEARANCE *>> taskbars;
+	std::unordered_map<HMONITOR, std::pair<Window, Config::TASKBAR_APPEARANCE>> taskbars;
 	bool should_show_peek = true;
 	bool is_running = true;
 	std::wstring config_folder;
@@ -52,6 +59,8 @@ static struct {
 	std::wstring exclude_file;
 	bool peek_active = false;
 	bool start_opened = false;
+	std::mutex loaded_config_lock;
+	std::optional<Config> loaded_config; // Loaded by a background thread, waiting for the main thread to adopt it
 } run;
 
 static const std::unordered_map<swca::ACCENT, uint32_t> REGULAR_BUTTOM_MAP = {
@@ -106,6 +115,7 @@ static const std::unordered_map<enum Config::PEEK, uint32_t> PEEK_BUTTON_MAP = {
 
 void SetWindowBlur(const Window &window, const swca::ACCENT &appearance, const uint32_t &color)
 {
+	TraceScope("SetWindowBlur");
 	if (user32::SetWindowCompositionAttribute)
 	{
 		static std::unordered_map<Window, bool> is_normal;
@@ -124,8 +134,13 @@ void SetWindowBlur(const Window &window, const swca::ACCENT &appearance, const u
 				// WM_THEMECHANGED makes the taskbar reload the theme and reapply the normal effect.
 				// Gotta memoize it because constantly sending it makes explorer's CPU usage jump.
 				window.send_message(WM_THEMECHANGED);
+				Metrics::Increment(Metrics::Counter::ThemeChangedSent);
 				is_normal[window] = true;
 			}
+			else
+			{
+				Metrics::Increment(Metrics::Counter::CompositionSkipped);
+			}
 			return;
 		}
 		else if (policy.nAccentState == swca::ACCENT::ACCENT_ENABLE_FLUENT && policy.nColor >> 24 == 0x00)
@@ -141,6 +156,7 @@ void SetWindowBlur(const Window &window, const swca::ACCENT &appearance, const u
 		};
 
 		user32::SetWindowCompositionAttribute(window, &data);
+		Metrics::Increment(Metrics::Counter::CompositionCalls);
 		is_normal[window] = false;
 	}
 }
@@ -249,20 +265,18 @@ bool CheckAndRunWelcome()
 
 void RefreshHandles()
 {
-	if (Config::VERBOSE)
-	{
-		Log::OutputMessage(L"Refreshing taskbar handles.");
-	}
+	const auto config = Config::Current();
+	LogMessage(Log::Level::Verbose, BinaryLog::MessageId::RefreshingHandles);
 
 	// Older handles are invalid, so clear the map to be ready for new ones
 	run.taskbars.clear();
 
 	run.main_taskbar = Window::Find(L"Shell_TrayWnd");
-	run.taskbars[run.main_taskbar.monitor()] = { run.main_taskbar, &Config::REGULAR_APPEARANCE };
+	run.taskbars[run.main_taskbar.monitor()] = { run.main_taskbar, config->REGULAR_APPEARANCE };
 
 	for (const Window secondtaskbar : Window::FindEnum(L"Shell_SecondaryTrayWnd"))
 	{
-		run.taskbars[secondtaskbar.monitor()] = { secondtaskbar, &Config::REGULAR_APPEARANCE };
+		run.taskbars[secondtaskbar.monitor()] = { secondtaskbar, config->REGULAR_APPEARANCE };
 	}
 }
 
@@ -327,10 +341,26 @@ void RefreshAutostartMenu(HMENU menu, const Autostart::StartupState &state)
 
 void RefreshMenu(HMENU menu)
 {
-	TrayContextMenu::RefreshBool(IDM_AUTOSTART, menu, false, TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::RefreshBool(IDM_AUTOSTART, menu, false, TrayContextMenu::Toggle);
-	TrayContextMenu::ChangeItemText(menu, IDM_AUTOSTART, L"Querying startup state...");
-	Autostart::GetStartupState().then(std::bind(&RefreshAutostartMenu, menu, std::placeholders::_1));
+	static std::optional<Autostart::StartupState> shown_startup_state;
+	if (const auto state = Autostart::GetCachedStartupState())
+	{
+		if (shown_startup_state != state)
+		{
+			RefreshAutostartMenu(menu, *state);
+			shown_startup_state = state;
+		}
+	}
+	else
+	{
+		shown_startup_state.reset();
+		TrayContextMenu::RefreshBool(IDM_AUTOSTART, menu, false, TrayContextMenu::ControlsEnabled);
+		TrayContextMenu::RefreshBool(IDM_AUTOSTART, menu, false, TrayContextMenu::Toggle);
+		TrayContextMenu::ChangeItemText(menu, IDM_AUTOSTART, L"Querying startup state...");
+		Autostart::GetStartupState().then([menu](const Autostart::StartupState &state)
+		{
+			RefreshAutostartMenu(menu, state);
+		});
+	}
 
 
 	static bool initial_check_done = false;
@@ -348,45 +378,41 @@ void RefreshMenu(HMENU menu)
 			TrayContextMenu::ChangeItemText(menu, IDM_TIMELINE_POPUP, L"Task View opened");
 		}
 
+#ifdef NO_TRACING
+		RemoveMenu(menu, IDM_SAVETRACE, MF_BYCOMMAND);
+#endif
+
 		initial_check_done = true;
 	}
 
-	const bool has_log = !Log::file().empty();
-	TrayContextMenu::RefreshBool(IDM_OPENLOG, menu, has_log, TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::ChangeItemText(menu, IDM_OPENLOG, has_log
-		? L"Open log file"
-		: Log::init_done()
-			? L"Error when initializing log file"
-			: L"Nothing has been logged yet"
-	);
+	// Once the log is initialized, it stays either available or failed, and the item doesn't change anymore.
+	static bool log_state_final = false;
+	if (!log_state_final)
+	{
+		const bool init_done = Log::init_done();
+		const bool has_log = init_done && !Log::file().empty();
+		TrayContextMenu::RefreshBool(IDM_OPENLOG, menu, has_log, TrayContextMenu::ControlsEnabled);
+		TrayContextMenu::ChangeItemText(menu, IDM_OPENLOG, has_log
+			? L"Open log file"
+			: init_done
+				? L"Error when initializing log file"
+				: L"Nothing has been logged yet"
+		);
+
+		log_state_final = init_done;
+	}
 
-	TrayContextMenu::RefreshBool(IDM_REGULAR_COLOR,   menu,
-		Config::REGULAR_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL,
-		TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::RefreshBool(IDM_MAXIMISED_COLOR, menu,
-		Config::MAXIMISED_ENABLED && Config::MAXIMISED_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL,
-		TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::RefreshBool(IDM_START_COLOR,     menu,
-		Config::START_ENABLED     && Config::START_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL,
-		TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::RefreshBool(IDM_CORTANA_COLOR,     menu,
-		Config::CORTANA_ENABLED   && Config::CORTANA_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL,
-		TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::RefreshBool(IDM_TIMELINE_COLOR,  menu,
-		Config::TIMELINE_ENABLED  && Config::TIMELINE_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL,
-		TrayContextMenu::ControlsEnabled);
-	TrayContextMenu::RefreshBool(IDM_PEEK_ONLY_MAIN,  menu,
-		Config::PEEK == Config::PEEK::Dynamic,
-		TrayContextMenu::ControlsEnabled);
 }
 
 #pragma endregion
 
 #pragma region Main logic
 
-BOOL CALLBACK EnumWindowsProcess(const HWND hWnd, LPARAM)
+BOOL CALLBACK EnumWindowsProcess(const HWND hWnd, LPARAM lParam)
 {
+	const Config &config = *reinterpret_cast<const Config *>(lParam);
 	const Window window(hWnd);
+	Metrics::Increment(Metrics::Counter::WindowsInspected);
 	// DWMWA_CLOAKED should take care of checking if it's on the current desktop.
 	// But that's undocumented behavior.
 	// Do both but with on_current_desktop last.
@@ -394,14 +420,14 @@ BOOL CALLBACK EnumWindowsProcess(const HWND hWnd, LPARAM)
 		!Blacklist::IsBlacklisted(window) && window.on_current_desktop() && run.taskbars.count(window.monitor()) != 0)
 	{
 		auto &taskbar = run.taskbars.at(window.monitor());
-		if (Config::MAXIMISED_ENABLED)
+		if (config.MAXIMISED_ENABLED)
 		{
-			taskbar.second = &Config::MAXIMISED_APPEARANCE;
+			taskbar.second = config.MAXIMISED_APPEARANCE;
 		}
 
-		if (Config::PEEK == Config::PEEK::Dynamic)
+		if (config.PEEK == Config::PEEK::Dynamic)
 		{
-			if (Config::PEEK_ONLY_MAIN)
+			if (config.PEEK_ONLY_MAIN)
 			{
 				if (taskbar.first == run.main_taskbar)
 				{
@@ -417,23 +443,31 @@ BOOL CALLBACK EnumWindowsProcess(const HWND hWnd, LPARAM)
 	return true;
 }
 
-void SetTaskbarBlur()
+void SetTaskbarBlur(const std::shared_ptr<const Config> &snapshot)
 {
-	static uint8_t counter = 10;
-
-	if (counter >= 10)	// Change this if you want to change the time it takes for the program to update.
-	{					// 1 = Config::SLEEP_TIME; we use 10 (assuming the default configuration value of 10),
-						// because the difference is less noticeable and it has no large impact on CPU.
-						// We can change this if we feel that CPU is more important than response time.
-		run.should_show_peek = (Config::PEEK == Config::PEEK::Enabled);
+	static TickSchedule schedule(10);	// Change this if you want to change the time it takes for the program to update.
+										// 1 = Config::SLEEP_TIME; we use 10 (assuming the default configuration value of 10),
+										// because the difference is less noticeable and it has no large impact on CPU.
+										// We can change this if we feel that CPU is more important than response time.
+	static std::shared_ptr<const Config> last_snapshot;
+
+	TraceScope("SetTaskbarBlur");
+	const Metrics::Timer timer(Metrics::Histogram::TickDuration);
+	const Metrics::CpuTimer cpu_timer(Metrics::Histogram::TickCpuCycles, Metrics::Counter::WorkerCpuTime);
+	const Config &config = *snapshot;
+	if (schedule.Begin(snapshot != last_snapshot))
+	{
+		run.should_show_peek = (config.PEEK == Config::PEEK::Enabled);
 
 		for (auto &[_, pair] : run.taskbars)
 		{
-			pair.second = &Config::REGULAR_APPEARANCE; // Reset taskbar state
+			pair.second = config.REGULAR_APPEARANCE; // Reset taskbar state
 		}
-		if (Config::MAXIMISED_ENABLED || Config::PEEK == Config::PEEK::Dynamic)
+		if (config.MAXIMISED_ENABLED || config.PEEK == Config::PEEK::Dynamic)
 		{
-			EnumWindows(&EnumWindowsProcess, NULL);
+			TraceScope("EnumWindows");
+			Metrics::Increment(Metrics::Counter::Enumerations);
+			EnumWindows(&EnumWindowsProcess, reinterpret_cast<LPARAM>(&config));
 		}
 
 		TogglePeek(run.should_show_peek);
@@ -441,86 +475,135 @@ void SetTaskbarBlur()
 		const Window fg_window = Window::ForegroundWindow();
 		if (fg_window != Window::NullWindow && run.taskbars.count(fg_window.monitor()) != 0)
 		{
-			if (Config::CORTANA_ENABLED && !fg_window.get_attribute<BOOL>(DWMWA_CLOAKED) &&
+			if (config.CORTANA_ENABLED && !fg_window.get_attribute<BOOL>(DWMWA_CLOAKED) &&
 				Util::IgnoreCaseStringEquals(*fg_window.filename(), L"SearchUI.exe"))
 			{
-				run.taskbars.at(fg_window.monitor()).second = &Config::CORTANA_APPEARANCE;
+				run.taskbars.at(fg_window.monitor()).second = config.CORTANA_APPEARANCE;
 			}
 
-			if (Config::START_ENABLED && run.start_opened)
+			if (config.START_ENABLED && run.start_opened)
 			{
-				run.taskbars.at(fg_window.monitor()).second = &Config::START_APPEARANCE;
+				run.taskbars.at(fg_window.monitor()).second = config.START_APPEARANCE;
 			}
 		}
 
 		// Put this between Start/Cortana and Task view/Timeline
 		// Task view and Timeline show over Aero Peek, but not Start or Cortana
-		if (Config::MAXIMISED_ENABLED && Config::MAXIMISED_REGULAR_ON_PEEK && run.peek_active)
+		if (config.MAXIMISED_ENABLED && config.MAXIMISED_REGULAR_ON_PEEK && run.peek_active)
 		{
 			for (auto &[_, pair] : run.taskbars)
 			{
-				pair.second = &Config::REGULAR_APPEARANCE;
+				pair.second = config.REGULAR_APPEARANCE;
 			}
 		}
 
 		if (fg_window != Window::NullWindow)
 		{
 			const static bool timeline_av = win32::IsAtLeastBuild(MIN_FLUENT_BUILD);
-			if (Config::TIMELINE_ENABLED && (timeline_av
+			if (config.TIMELINE_ENABLED && (timeline_av
 				? (*fg_window.classname() == CORE_WINDOW && Util::IgnoreCaseStringEquals(*fg_window.filename(), L"Explorer.exe"))
 				: (*fg_window.classname() == L"MultitaskingViewFrame")))
 			{
 				for (auto &[_, pair] : run.taskbars)
 				{
-					pair.second = &Config::TIMELINE_APPEARANCE;
+					pair.second = config.TIMELINE_APPEARANCE;
 				}
 			}
 		}
 
-		counter = 0;
-	}
-	else
-	{
-		counter++;
+		last_snapshot = snapshot;
 	}
 
+	static std::unordered_map<Window, Config::TASKBAR_APPEARANCE> last_appearances;
+	bool changed = false;
 	for (const auto &[_, pair] : run.taskbars)
 	{
-		const Config::TASKBAR_APPEARANCE &appearance = *pair.second;
+		const Config::TASKBAR_APPEARANCE &appearance = pair.second;
 		SetWindowBlur(pair.first, appearance.ACCENT, appearance.COLOR);
+
+		const auto [it, inserted] = last_appearances.try_emplace(pair.first, appearance);
+		if (inserted || it->second.ACCENT != appearance.ACCENT || it->second.COLOR != appearance.COLOR)
+		{
+			it->second = appearance;
+			changed = true;
+		}
 	}
+
+	schedule.End(changed);
 }
 
 #pragma endregion
 
 #pragma region Startup
 
-long ExitApp(const EXITREASON &reason, ...)
+long ExitApp(const EXITREASON &reason)
 {
 	run.exit_reason = reason;
 	PostQuitMessage(0);
 	return 0;
 }
 
+// Diagnostics are saved next to the log files, so that they count towards its budget.
+std::wstring GetDiagnosticsFile(std::wstring_view name, std::wstring_view extension = L".json")
+{
+	const std::wstring &folder = Log::folder();
+	if (folder.empty())
+	{
+		MessageBox(Window::NullWindow, L"Diagnostics are saved next to the log files, but the log failed to initialize.", NAME, MB_ICONWARNING | MB_OK | MB_SETFOREGROUND);
+		return { };
+	}
+
+	std::wstring file = folder;
+	file += L'\\';
+	file += name;
+	file += L'-';
+	file += std::to_wstring(std::time(0));
+	file += extension;
+	return file;
+}
+
 void InitializeTray(const HINSTANCE &hInstance)
 {
 	static MessageWindow window(L"TrayWindow", NAME, hInstance);
 
-	window.RegisterCallback(NEW_TTB_INSTANCE, std::bind(&ExitApp, EXITREASON::NewInstance));
+	window.RegisterCallback(NEW_TTB_INSTANCE, [](WPARAM, LPARAM)
+	{
+		return ExitApp(EXITREASON::NewInstance);
+	});
 
-	window.RegisterCallback(WM_DISPLAYCHANGE, [](...)
+	window.RegisterCallback(WM_DISPLAYCHANGE, [](WPARAM, LPARAM)
 	{
 		RefreshHandles();
 		return 0;
 	});
 
-	window.RegisterCallback(WM_TASKBARCREATED, [](...)
+	window.RegisterCallback(WM_TASKBARCREATED, [](WPARAM, LPARAM)
 	{
 		RefreshHandles();
 		return 0;
 	});
 
-	window.RegisterCallback(WM_CLOSE, std::bind(&ExitApp, EXITREASON::UserAction));
+	window.RegisterCallback(WM_CLOSE, [](WPARAM, LPARAM)
+	{
+		return ExitApp(EXITREASON::UserAction);
+	});
+
+	window.RegisterCallback(WM_CONFIGLOADED, [](WPARAM, LPARAM)
+	{
+		std::optional<Config> config;
+		{
+			std::lock_guard guard(run.loaded_config_lock);
+			config.swap(run.loaded_config);
+		}
+
+		if (config)
+		{
+			Config::Working = *config;
+			Config::Publish();
+		}
+
+		return 0;
+	});
 
 	window.RegisterCallback(WM_QUERYENDSESSION, [](WPARAM, const LPARAM lParam)
 	{
@@ -537,84 +620,120 @@ void InitializeTray(const HINSTANCE &hInstance)
 		if (!(lParam & ENDSESSION_CLOSEAPP && !wParam))
 		{
 			// The app is being closed for an update or shutdown.
-			Config::Save(run.config_file);
+			Config::Working.Save(run.config_file);
 		}
 
 		return 0;
 	});
 
 
-	if (!Config::NO_TRAY)
+	if (!Config::Working.NO_TRAY)
 	{
 		static TrayContextMenu tray(window, MAKEINTRESOURCE(TRAYICON), MAKEINTRESOURCE(IDR_POPUP_MENU), hInstance);
 
-		tray.BindColor(IDM_REGULAR_COLOR, Config::REGULAR_APPEARANCE.COLOR);
-		tray.BindEnum(Config::REGULAR_APPEARANCE.ACCENT, REGULAR_BUTTOM_MAP);
+		tray.BindColor(IDM_REGULAR_COLOR, Config::Working.REGULAR_APPEARANCE.COLOR);
+		tray.BindBool(IDM_REGULAR_COLOR, []
+		{
+			return Config::Working.REGULAR_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL;
+		}, TrayContextMenu::ControlsEnabled);
+		tray.BindEnum(Config::Working.REGULAR_APPEARANCE.ACCENT, REGULAR_BUTTOM_MAP);
 
 
-		tray.BindBool(IDM_MAXIMISED,      Config::MAXIMISED_ENABLED,         TrayContextMenu::Toggle);
-		tray.BindBool(IDM_MAXIMISED_PEEK, Config::MAXIMISED_ENABLED,         TrayContextMenu::ControlsEnabled);
-		tray.BindBool(IDM_MAXIMISED_PEEK, Config::MAXIMISED_REGULAR_ON_PEEK, TrayContextMenu::Toggle);
-		tray.BindColor(IDM_MAXIMISED_COLOR, Config::MAXIMISED_APPEARANCE.COLOR);
-		tray.BindEnum(Config::MAXIMISED_APPEARANCE.ACCENT, MAXIMISED_BUTTON_MAP);
+		tray.BindBool(IDM_MAXIMISED,      Config::Working.MAXIMISED_ENABLED,         TrayContextMenu::Toggle);
+		tray.BindBool(IDM_MAXIMISED_PEEK, Config::Working.MAXIMISED_ENABLED,         TrayContextMenu::ControlsEnabled);
+		tray.BindBool(IDM_MAXIMISED_PEEK, Config::Working.MAXIMISED_REGULAR_ON_PEEK, TrayContextMenu::Toggle);
+		tray.BindColor(IDM_MAXIMISED_COLOR, Config::Working.MAXIMISED_APPEARANCE.COLOR);
+		tray.BindBool(IDM_MAXIMISED_COLOR, []
+		{
+			return Config::Working.MAXIMISED_ENABLED && Config::Working.MAXIMISED_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL;
+		}, TrayContextMenu::ControlsEnabled);
+		tray.BindEnum(Config::Working.MAXIMISED_APPEARANCE.ACCENT, MAXIMISED_BUTTON_MAP);
 		for (const auto &[_, id] : MAXIMISED_BUTTON_MAP)
 		{
-			tray.BindBool(id, Config::MAXIMISED_ENABLED, TrayContextMenu::ControlsEnabled);
+			tray.BindBool(id, Config::Working.MAXIMISED_ENABLED, TrayContextMenu::ControlsEnabled);
 		}
 
 
-		tray.BindBool(IDM_START, Config::START_ENABLED, TrayContextMenu::Toggle);
-		tray.BindColor(IDM_START_COLOR, Config::START_APPEARANCE.COLOR);
-		tray.BindEnum(Config::START_APPEARANCE.ACCENT, START_BUTTON_MAP);
+		tray.BindBool(IDM_START, Config::Working.START_ENABLED, TrayContextMenu::Toggle);
+		tray.BindColor(IDM_START_COLOR, Config::Working.START_APPEARANCE.COLOR);
+		tray.BindBool(IDM_START_COLOR, []
+		{
+			return Config::Working.START_ENABLED && Config::Working.START_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL;
+		}, TrayContextMenu::ControlsEnabled);
+		tray.BindEnum(Config::Working.START_APPEARANCE.ACCENT, START_BUTTON_MAP);
 		for (const auto &[_, id] : START_BUTTON_MAP)
 		{
-			tray.BindBool(id, Config::START_ENABLED, TrayContextMenu::ControlsEnabled);
+			tray.BindBool(id, Config::Working.START_ENABLED, TrayContextMenu::ControlsEnabled);
 		}
 
-		tray.BindBool(IDM_CORTANA, Config::CORTANA_ENABLED, TrayContextMenu::Toggle);
-		tray.BindColor(IDM_CORTANA_COLOR, Config::CORTANA_APPEARANCE.COLOR);
-		tray.BindEnum(Config::CORTANA_APPEARANCE.ACCENT, CORTANA_BUTTON_MAP);
+		tray.BindBool(IDM_CORTANA, Config::Working.CORTANA_ENABLED, TrayContextMenu::Toggle);
+		tray.BindColor(IDM_CORTANA_COLOR, Config::Working.CORTANA_APPEARANCE.COLOR);
+		tray.BindBool(IDM_CORTANA_COLOR, []
+		{
+			return Config::Working.CORTANA_ENABLED && Config::Working.CORTANA_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL;
+		}, TrayContextMenu::ControlsEnabled);
+		tray.BindEnum(Config::Working.CORTANA_APPEARANCE.ACCENT, CORTANA_BUTTON_MAP);
 		for (const auto &[_, id] : CORTANA_BUTTON_MAP)
 		{
-			tray.BindBool(id, Config::CORTANA_ENABLED, TrayContextMenu::ControlsEnabled);
+			tray.BindBool(id, Config::Working.CORTANA_ENABLED, TrayContextMenu::ControlsEnabled);
 		}
 
 
-		tray.BindBool(IDM_TIMELINE, Config::TIMELINE_ENABLED, TrayContextMenu::Toggle);
-		tray.BindColor(IDM_TIMELINE_COLOR, Config::TIMELINE_APPEARANCE.COLOR);
-		tray.BindEnum(Config::TIMELINE_APPEARANCE.ACCENT, TIMELINE_BUTTON_MAP);
+		tray.BindBool(IDM_TIMELINE, Config::Working.TIMELINE_ENABLED, TrayContextMenu::Toggle);
+		tray.BindColor(IDM_TIMELINE_COLOR, Config::Working.TIMELINE_APPEARANCE.COLOR);
+		tray.BindBool(IDM_TIMELINE_COLOR, []
+		{
+			return Config::Working.TIMELINE_ENABLED && Config::Working.TIMELINE_APPEARANCE.ACCENT != swca::ACCENT::ACCENT_NORMAL;
+		}, TrayContextMenu::ControlsEnabled);
+		tray.BindEnum(Config::Working.TIMELINE_APPEARANCE.ACCENT, TIMELINE_BUTTON_MAP);
 		for (const auto &[_, id] : TIMELINE_BUTTON_MAP)
 		{
-			tray.BindBool(id, Config::TIMELINE_ENABLED, TrayContextMenu::ControlsEnabled);
+			tray.BindBool(id, Config::Working.TIMELINE_ENABLED, TrayContextMenu::ControlsEnabled);
 		}
 
 
-		tray.BindEnum(Config::PEEK, PEEK_BUTTON_MAP);
-		tray.BindBool(IDM_PEEK_ONLY_MAIN, Config::PEEK_ONLY_MAIN, TrayContextMenu::Toggle);
+		tray.BindEnum(Config::Working.PEEK, PEEK_BUTTON_MAP);
+		tray.BindBool(IDM_PEEK_ONLY_MAIN, Config::Working.PEEK_ONLY_MAIN, TrayContextMenu::Toggle);
+		tray.BindBool(IDM_PEEK_ONLY_MAIN, []
+		{
+			return Config::Working.PEEK == Config::PEEK::Dynamic;
+		}, TrayContextMenu::ControlsEnabled);
 
 
 		tray.RegisterContextMenuCallback(IDM_OPENLOG, []
 		{
 			std::thread([]
 			{
-				Log::Flush();
-				win32::EditFile(Log::file());
+				win32::EditFile(Log::ViewableFile());
 			}).detach();
 		});
-		tray.BindBool(IDM_VERBOSE, Config::VERBOSE, TrayContextMenu::Toggle);
+		tray.BindBool(IDM_VERBOSE, Config::Working.VERBOSE, TrayContextMenu::Toggle);
 		tray.RegisterContextMenuCallback(IDM_SAVESETTINGS, []
 		{
-			Config::Save(run.config_file);
-			std::thread(std::bind(&MessageBox, Window::NullWindow, L"Settings have been saved.", NAME, MB_OK | MB_ICONINFORMATION | MB_SETFOREGROUND)).detach();
+			Config::Working.Save(run.config_file);
+			std::thread([]
+			{
+				MessageBox(Window::NullWindow, L"Settings have been saved.", NAME, MB_OK | MB_ICONINFORMATION | MB_SETFOREGROUND);
+			}).detach();
+		});
+		tray.RegisterContextMenuCallback(IDM_RELOADSETTINGS, []
+		{
+			Config::Parse(run.config_file);
 		});
-		tray.RegisterContextMenuCallback(IDM_RELOADSETTINGS, std::bind(&Config::Parse, std::ref(run.config_file)));
 		tray.RegisterContextMenuCallback(IDM_EDITSETTINGS, []
 		{
-			Config::Save(run.config_file);
+			Config::Working.Save(run.config_file);
 			std::thread([]
 			{
 				win32::EditFile(run.config_file);
-				Config::Parse(run.config_file);
+
+				// Parse here, but let the main thread adopt the result.
+				{
+					Config config = Config::Load(run.config_file);
+					std::lock_guard guard(run.loaded_config_lock);
+					run.loaded_config = config;
+				}
+				window.send_message(WM_CONFIGLOADED);
 			}).detach();
 		});
 		tray.RegisterContextMenuCallback(IDM_RETURNTODEFAULTSETTINGS, []
@@ -622,7 +741,10 @@ void InitializeTray(const HINSTANCE &hInstance)
 			ApplyStock(CONFIG_FILE);
 			Config::Parse(run.config_file);
 		});
-		tray.RegisterContextMenuCallback(IDM_RELOADDYNAMICBLACKLIST, std::bind(&Blacklist::Parse, std::ref(run.exclude_file)));
+		tray.RegisterContextMenuCallback(IDM_RELOADDYNAMICBLACKLIST, []
+		{
+			Blacklist::Parse(run.exclude_file);
+		});
 		tray.RegisterContextMenuCallback(IDM_EDITDYNAMICBLACKLIST, []
 		{
 			std::thread([]
@@ -637,7 +759,73 @@ void InitializeTray(const HINSTANCE &hInstance)
 			Blacklist::Parse(run.exclude_file);
 		});
 		tray.RegisterContextMenuCallback(IDM_CLEARBLACKLISTCACHE, Blacklist::ClearCache);
-		tray.RegisterContextMenuCallback(IDM_EXITWITHOUTSAVING, std::bind(&ExitApp, EXITREASON::UserActionNoSave));
+		tray.RegisterContextMenuCallback(IDM_DUMPBLACKLISTSTATS, []
+		{
+			std::thread([]
+			{
+				const std::wstring file = GetDiagnosticsFile(L"blacklist", L".txt");
+				if (file.empty())
+				{
+					return;
+				}
+
+				if (Blacklist::DumpStatistics(file))
+				{
+					win32::EditFile(file);
+				}
+				else
+				{
+					LastErrorHandle(Error::Level::Error, L"Failed to save blacklist statistics.");
+				}
+			}).detach();
+		});
+		tray.RegisterContextMenuCallback(IDM_SAVETRACE, []
+		{
+			std::thread([]
+			{
+				static constexpr uint32_t TRACE_SECONDS = 10;
+
+				const std::wstring file = GetDiagnosticsFile(L"trace");
+				if (file.empty())
+				{
+					return;
+				}
+
+				if (Trace::Save(file, TRACE_SECONDS))
+				{
+					Log::Output(BinaryLog::MessageId::TraceSaved, TRACE_SECONDS, file);
+					win32::OpenLink(Log::folder());
+				}
+				else
+				{
+					LastErrorHandle(Error::Level::Error, L"Failed to save trace.");
+				}
+			}).detach();
+		});
+		tray.RegisterContextMenuCallback(IDM_SAVEMETRICS, []
+		{
+			std::thread([]
+			{
+				const std::wstring file = GetDiagnosticsFile(L"metrics");
+				if (file.empty())
+				{
+					return;
+				}
+
+				if (Metrics::Save(file))
+				{
+					win32::EditFile(file);
+				}
+				else
+				{
+					LastErrorHandle(Error::Level::Error, L"Failed to save metrics.");
+				}
+			}).detach();
+		});
+		tray.RegisterContextMenuCallback(IDM_EXITWITHOUTSAVING, []
+		{
+			ExitApp(EXITREASON::UserActionNoSave);
+		});
 
 
 		tray.RegisterContextMenuCallback(IDM_AUTOSTART, []
@@ -647,12 +835,18 @@ void InitializeTray(const HINSTANCE &hInstance)
 				Autostart::SetStartupState(result == Autostart::StartupState::Enabled ? Autostart::StartupState::Disabled : Autostart::StartupState::Enabled);
 			});
 		});
-		tray.RegisterContextMenuCallback(IDM_TIPS, std::bind(&win32::OpenLink,
-			L"https://github.com/TranslucentTB/TranslucentTB/wiki/Tips-and-tricks-for-a-better-looking-taskbar"));
-		tray.RegisterContextMenuCallback(IDM_EXIT, std::bind(&ExitApp, EXITREASON::UserAction));
+		tray.RegisterContextMenuCallback(IDM_TIPS, []
+		{
+			win32::OpenLink(L"https://github.com/TranslucentTB/TranslucentTB/wiki/Tips-and-tricks-for-a-better-looking-taskbar");
+		});
+		tray.RegisterContextMenuCallback(IDM_EXIT, []
+		{
+			ExitApp(EXITREASON::UserAction);
+		});
 
 
 		tray.RegisterCustomRefresh(RefreshMenu);
+		tray.RegisterChangeCallback(Config::Publish);
 	}
 }
 
@@ -697,9 +891,10 @@ int WINAPI wWinMain(const HINSTANCE hInstance, HINSTANCE, wchar_t *, int)
 	EventHook peek_hook(
 		0x21,
 		0x22,
-		[](const DWORD event, ...)
+		[](const DWORD event, const Window &, LONG, LONG, DWORD, const DWORD time)
 		{
 			run.peek_active = event == 0x21;
+			Metrics::EventOccurred(Metrics::Histogram::PeekLatency, Metrics::FromEventTime(time));
 		},
 		WINEVENT_OUTOFCONTEXT
 	);
@@ -708,16 +903,36 @@ int WINAPI wWinMain(const HINSTANCE hInstance, HINSTANCE, wchar_t *, int)
 	EventHook creation_hook(
 		EVENT_OBJECT_CREATE,
 		EVENT_OBJECT_CREATE,
-		[](DWORD, const Window &window, ...)
+		[](DWORD, const Window &window, LONG, LONG, DWORD, DWORD)
 		{
 			if (window.valid() && *window.classname() == L"Shell_SecondaryTrayWnd")
 			{
-				run.taskbars[window.monitor()] = { window, &Config::REGULAR_APPEARANCE };
+				run.taskbars[window.monitor()] = { window, Config::Current()->REGULAR_APPEARANCE };
 			}
 		},
 		WINEVENT_OUTOFCONTEXT
 	);
 
+	// Only used to measure how long it takes to react to these, see Metrics.
+	EventHook foreground_hook(
+		EVENT_SYSTEM_FOREGROUND,
+		EVENT_SYSTEM_FOREGROUND,
+		[](DWORD, const Window &, LONG, LONG, DWORD, const DWORD time)
+		{
+			Metrics::EventOccurred(Metrics::Histogram::ForegroundLatency, Metrics::FromEventTime(time));
+		},
+		WINEVENT_OUTOFCONTEXT
+	);
+
+	// Maximising with the caption button only raises EVENT_OBJECT_LOCATIONCHANGE, which also fires on every
+	// cursor move. Snapping, dragging and restoring are the next best thing.
+	const auto maximise_callback = [](DWORD, const Window &, LONG, LONG, DWORD, const DWORD time)
+	{
+		Metrics::EventOccurred(Metrics::Histogram::MaximisedLatency, Metrics::FromEventTime(time));
+	};
+	EventHook movesize_hook(EVENT_SYSTEM_MOVESIZEEND, EVENT_SYSTEM_MOVESIZEEND, maximise_callback, WINEVENT_OUTOFCONTEXT);
+	EventHook restore_hook(EVENT_SYSTEM_MINIMIZEEND, EVENT_SYSTEM_MINIMIZEEND, maximise_callback, WINEVENT_OUTOFCONTEXT);
+
 	// Register our start menu detection sink
 	auto app_visibility = create_instance<IAppVisibility>(CLSID_AppVisibility);
 	DWORD av_cookie = 0;
@@ -741,8 +956,11 @@ int WINAPI wWinMain(const HINSTANCE hInstance, HINSTANCE, wchar_t *, int)
 
 		while (run.is_running)
 		{
-			SetTaskbarBlur();
-			std::this_thread::sleep_for(std::chrono::milliseconds(Config::SLEEP_TIME));
+			// Use the same configuration for the whole tick, and wake up early if it changes.
+			Metrics::Increment(Metrics::Counter::Wakeups);
+			const auto config = Config::Current();
+			SetTaskbarBlur(config);
+			Config::WaitForChange(config, std::chrono::milliseconds(config->SLEEP_TIME));
 		}
 	});
 
@@ -776,12 +994,19 @@ int WINAPI wWinMain(const HINSTANCE hInstance, HINSTANCE, wchar_t *, int)
 	//    and if we have actual leaks, they won't be drowned in the noise since closing the window will make CPicker cleanup.
 	win32::ClosePickers();
 
+	// The pickers we just closed handed back the colors they had before being opened, apply them.
+	const unsigned int color_message = RegisterWindowMessage(WM_COLORCHANGED);
+	while (PeekMessage(&msg, Window::NullWindow, color_message, color_message, PM_REMOVE))
+	{
+		DispatchMessage(&msg);
+	}
+
 	// If it's a new instance, don't save or restore taskbar to default
 	if (run.exit_reason != EXITREASON::NewInstance)
 	{
 		if (run.exit_reason != EXITREASON::UserActionNoSave)
 		{
-			Config::Save(run.config_file);
+			Config::Working.Save(run.config_file);
 		}
 
 		// Restore default taskbar appearance
@@ -792,6 +1017,9 @@ int WINAPI wWinMain(const HINSTANCE hInstance, HINSTANCE, wchar_t *, int)
 		}
 	}
 
+	// The log writer thread doesn't outlive us, make sure it wrote everything.
+	Log::Flush();
+
 	return EXIT_SUCCESS;
 }
 
@@ -0,0 +1,94 @@
+#pragma once
+#include "arch.h"
+#include <cstddef>
+#include <cstdint>
+#include <fileapi.h>
+#include <handleapi.h>
+#include <memoryapi.h>
+#include <string>
+#include <winerror.h>
+#include <winrt/base.h>
+
+struct mapped_view_traits {
+
+	using type = const void *;
+
+	inline static void close(type value) noexcept
+	{
+		WINRT_VERIFY(UnmapViewOfFile(value));
+	}
+
+	static constexpr type invalid() noexcept
+	{
+		return nullptr;
+	}
+};
+
+using mapped_view = winrt::handle_type<mapped_view_traits>;
+
+// A read-only view of a whole file. Check the last error if the mapping ends up invalid.
+class MappedFile {
+
+private:
+	mapped_view m_View;
+	size_t m_Size;
+
+public:
+	inline MappedFile() : m_Size(0) { }
+
+	inline explicit MappedFile(const std::wstring &file) : m_Size(0)
+	{
+		const winrt::file_handle handle(CreateFile(file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+		if (!handle)
+		{
+			return;
+		}
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(handle.get(), &size))
+		{
+			return;
+		}
+
+		if (size.QuadPart == 0 || static_cast<uint64_t>(size.QuadPart) > SIZE_MAX)
+		{
+			// Empty files can't be mapped, and files bigger than the address space can't be viewed in one go.
+			SetLastError(size.QuadPart == 0 ? ERROR_FILE_INVALID : ERROR_FILE_TOO_LARGE);
+			return;
+		}
+
+		// The view keeps the mapping object alive, we don't need to hold onto it.
+		const winrt::handle mapping(CreateFileMapping(handle.get(), NULL, PAGE_READONLY, 0, 0, NULL));
+		if (!mapping)
+		{
+			return;
+		}
+
+		m_View.attach(MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0));
+		if (m_View)
+		{
+			m_Size = static_cast<size_t>(size.QuadPart);
+		}
+	}
+
+	inline const uint8_t *data() const
+	{
+		return static_cast<const uint8_t *>(m_View.get());
+	}
+
+	inline size_t size() const
+	{
+		return m_Size;
+	}
+
+	inline explicit operator bool() const
+	{
+		return static_cast<bool>(m_View);
+	}
+
+	inline void reset()
+	{
+		m_View.close();
+		m_Size = 0;
+	}
+};
\ No newline at end of file
@@ -2,19 +2,25 @@
 #include <algorithm>
 
 #include "ttberror.hpp"
-#include "util.hpp"
 
 LRESULT MessageWindow::WindowProcedure(const Window &window, unsigned int uMsg, WPARAM wParam, LPARAM lParam)
 {
-	const auto &callbackVector = m_CallbackMap[uMsg];
-	if (callbackVector.size() > 0)
+	if (m_Filter[FilterIndex(uMsg)])
 	{
-		long result = 0;
-		for (const auto &[_, callback] : callbackVector)
+		auto it = std::lower_bound(m_Routes.begin(), m_Routes.end(), uMsg, [](const ROUTE &route, const unsigned int &value)
 		{
-			result = (std::max)(callback(wParam, lParam), result);
+			return route.message < value;
+		});
+
+		if (it != m_Routes.end() && it->message == uMsg)
+		{
+			long result = 0;
+			for (; it != m_Routes.end() && it->message == uMsg; ++it)
+			{
+				result = (std::max)(m_Callbacks.find(it->cookie)->callback(wParam, lParam), result);
+			}
+			return result;
 		}
-		return result;
 	}
 
 	return DefWindowProc(window, uMsg, wParam, lParam);
@@ -22,14 +28,17 @@ LRESULT MessageWindow::WindowProcedure(const Window &window, unsigned int uMsg,
 
 MessageWindow::MessageWindow(const std::wstring &className, const std::wstring &windowName, const HINSTANCE &hInstance, const wchar_t *iconResource) :
 	m_WindowClass(
-		std::bind(&MessageWindow::WindowProcedure, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3, std::placeholders::_4),
+		[this](const Window &window, unsigned int uMsg, WPARAM wParam, LPARAM lParam)
+		{
+			return WindowProcedure(window, uMsg, wParam, lParam);
+		},
 		className,
 		iconResource,
 		0,
 		hInstance
 	)
 {
-	m_WindowHandle = Window::Create(0, m_WindowClass, windowName, 0, 0, 0, 0, 0, Window::NullWindow, 0, hInstance, this);
+	m_WindowHandle = Window::Create(0, m_WindowClass, windowName, 0, 0, 0, 0, 0, Window::NullWindow, 0, hInstance);
 
 	if (!m_WindowHandle)
 	{
@@ -37,31 +46,49 @@ MessageWindow::MessageWindow(const std::wstring &className, const std::wstring &
 	}
 }
 
-MessageWindow::CALLBACKCOOKIE MessageWindow::RegisterCallback(unsigned int message, const callback_t &callback)
+MessageWindow::CALLBACKCOOKIE MessageWindow::RegisterCallback(unsigned int message, callback_t callback)
 {
-	unsigned short secret = Util::GetRandomNumber<unsigned short>();
-	m_CallbackMap[message].emplace_back(secret, callback);
+	const CALLBACKCOOKIE cookie = m_Callbacks.insert({ message, std::move(callback) });
 
-	return (static_cast<CALLBACKCOOKIE>(secret) << 32) + message;
+	// After the other callbacks of the same message, so they keep being called in registration order.
+	const auto it = std::upper_bound(m_Routes.begin(), m_Routes.end(), message, [](const unsigned int &value, const ROUTE &route)
+	{
+		return value < route.message;
+	});
+	m_Routes.insert(it, { message, cookie });
+	m_Filter.set(FilterIndex(message));
+
+	return cookie;
 }
 
 bool MessageWindow::UnregisterCallback(CALLBACKCOOKIE cookie)
 {
-	unsigned int message = cookie & 0xFFFFFFFF;
-	unsigned short secret = (cookie >> 32) & 0xFFFF;
+	const CALLBACK_ENTRY *entry = m_Callbacks.find(cookie);
+	if (!entry)
+	{
+		return false;
+	}
 
-	auto &callbackVector = m_CallbackMap[message];
-	for (auto &callbackPair : callbackVector)
+	const unsigned int message = entry->message;
+	m_Callbacks.erase(cookie);
+
+	auto it = std::lower_bound(m_Routes.begin(), m_Routes.end(), message, [](const ROUTE &route, const unsigned int &value)
 	{
-		if (callbackPair.first == secret)
-		{
-			std::swap(callbackPair, callbackVector.back());
-			callbackVector.pop_back();
-			return true;
-		}
+		return route.message < value;
+	});
+	while (it->cookie != cookie)
+	{
+		++it;
+	}
+	m_Routes.erase(it);
+
+	m_Filter.reset();
+	for (const ROUTE &route : m_Routes)
+	{
+		m_Filter.set(FilterIndex(route.message));
 	}
 
-	return false;
+	return true;
 }
 
 MessageWindow::~MessageWindow()
@@ -1,8 +1,10 @@
 #pragma once
-#include <functional>
-#include <unordered_map>
+#include <bitset>
+#include <cstddef>
 #include <vector>
 
+#include "slotmap.hpp"
+#include "smallfunction.hpp"
 #include "window.hpp"
 #include "windowclass.hpp"
 
@@ -10,22 +12,49 @@
 
 class MessageWindow : public Window {
 
-protected:
-	using callback_t = std::function<long(WPARAM, LPARAM)>;
+public:
+	using callback_t = SmallFunction<long(WPARAM, LPARAM)>;
+
+private:
+	struct CALLBACK_ENTRY {
+		unsigned int message;
+		callback_t callback;
+	};
+
+	SlotMap<CALLBACK_ENTRY> m_Callbacks;
+
+public:
+	using CALLBACKCOOKIE = SlotMap<CALLBACK_ENTRY>::key_type;
 
 private:
-	std::unordered_map<unsigned int, std::vector<std::pair<unsigned short, callback_t>>> m_CallbackMap;
+	struct ROUTE {
+		unsigned int message;
+		CALLBACKCOOKIE cookie;
+	};
+
+	// Sorted by message, so that the callbacks of a message are next to each other.
+	// Callbacks must not register or unregister callbacks.
+	std::vector<ROUTE> m_Routes;
+
+	// One bit per hash of the registered messages. Most messages a window gets aren't registered,
+	// and this sends them to DefWindowProc without searching.
+	std::bitset<256> m_Filter;
+
+	inline static std::size_t FilterIndex(const unsigned int &message)
+	{
+		return (message ^ (message >> 8)) & 0xFF;
+	}
+
 	WindowClass m_WindowClass;
 
 	LRESULT WindowProcedure(const Window &window, unsigned int uMsg, WPARAM wParam, LPARAM lParam);
 
 public:
 	MessageWindow(const std::wstring &className, const std::wstring &windowName, const HINSTANCE &hInstance = GetModuleHandle(NULL), const wchar_t *iconResource = MAKEINTRESOURCE(MAINICON));
-	using CALLBACKCOOKIE = unsigned long long;
-	CALLBACKCOOKIE RegisterCallback(unsigned int message, const callback_t &callback);
-	inline CALLBACKCOOKIE RegisterCallback(const std::wstring &message, const callback_t &callback)
+	CALLBACKCOOKIE RegisterCallback(unsigned int message, callback_t callback);
+	inline CALLBACKCOOKIE RegisterCallback(const std::wstring &message, callback_t callback)
 	{
-		return RegisterCallback(RegisterWindowMessage(message.c_str()), callback);
+		return RegisterCallback(RegisterWindowMessage(message.c_str()), std::move(callback));
 	}
 	bool UnregisterCallback(CALLBACKCOOKIE cookie);
 	~MessageWindow();
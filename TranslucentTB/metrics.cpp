@@ -0,0 +1,191 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <processthreadsapi.h>
+#include <realtimeapiset.h>
+#include <sstream>
+#include <sysinfoapi.h>
+
+#include "win32.hpp"
+
+std::mutex Metrics::m_ShardsLock;
+std::vector<std::unique_ptr<Metrics::SHARD>> Metrics::m_Shards;
+
+uint64_t Metrics::m_Frequency = []
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return static_cast<uint64_t>(frequency.QuadPart);
+}();
+
+uint64_t Metrics::m_Start = Now();
+
+std::atomic<uint64_t> Metrics::m_PendingEvents[HISTOGRAM_COUNT];
+
+Metrics::SHARD &Metrics::CreateShard()
+{
+	std::lock_guard guard(m_ShardsLock);
+
+	// Kept after the thread exits, so that its values still count.
+	return *m_Shards.emplace_back(std::make_unique<SHARD>());
+}
+
+uint64_t Metrics::BucketLowerBound(const uint32_t &index)
+{
+	if (index < SUB_BUCKETS)
+	{
+		return index;
+	}
+
+	const uint32_t exponent = (index - SUB_BUCKETS) / SUB_BUCKETS + SUB_BUCKET_BITS;
+	const uint64_t mantissa = SUB_BUCKETS + (index - SUB_BUCKETS) % SUB_BUCKETS;
+	return mantissa << (exponent - SUB_BUCKET_BITS);
+}
+
+uint64_t Metrics::HISTOGRAM_SNAPSHOT::percentile(const double &fraction) const
+{
+	if (count == 0)
+	{
+		return 0;
+	}
+
+	const uint64_t rank = std::max<uint64_t>(static_cast<uint64_t>(std::ceil(fraction * count)), 1);
+	uint64_t seen = 0;
+	for (uint32_t i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += buckets[i];
+		if (seen >= rank)
+		{
+			const uint64_t upper = i + 1 < BUCKET_COUNT ? BucketLowerBound(i + 1) - 1 : UINT64_MAX;
+			return std::min(upper, max);
+		}
+	}
+
+	return max;
+}
+
+uint64_t Metrics::ThreadCycles()
+{
+	ULONG64 cycles;
+	return QueryThreadCycleTime(GetCurrentThread(), &cycles) ? cycles : 0;
+}
+
+uint64_t Metrics::ThreadTime()
+{
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+	{
+		return 0;
+	}
+
+	return ((static_cast<uint64_t>(kernel.dwHighDateTime) << 32) | kernel.dwLowDateTime) +
+		((static_cast<uint64_t>(user.dwHighDateTime) << 32) | user.dwLowDateTime);
+}
+
+uint64_t Metrics::FromEventTime(const DWORD &event_time)
+{
+	const uint64_t now = Now();
+
+	// Both are milliseconds since boot, and wrap around together.
+	const uint64_t elapsed = static_cast<uint64_t>(GetTickCount() - event_time) * m_Frequency / 1000;
+	return now - std::min(now, elapsed);
+}
+
+Metrics::EVENTS Metrics::TakeEvents()
+{
+	EVENTS events;
+	for (size_t i = 0; i < HISTOGRAM_COUNT; i++)
+	{
+		events.origins[i] = m_PendingEvents[i].exchange(0, std::memory_order_relaxed);
+	}
+
+	return events;
+}
+
+void Metrics::EventsApplied(const EVENTS &events, const uint64_t &now)
+{
+	for (uint32_t i = 0; i < HISTOGRAM_COUNT; i++)
+	{
+		if (events.origins[i] != 0)
+		{
+			Record(static_cast<Histogram>(i), ToMicroseconds(now - std::min(now, events.origins[i])));
+		}
+	}
+}
+
+Metrics::SNAPSHOT Metrics::Snapshot()
+{
+	SNAPSHOT snapshot = { };
+
+	std::lock_guard guard(m_ShardsLock);
+	for (const std::unique_ptr<SHARD> &shard : m_Shards)
+	{
+		for (size_t i = 0; i < COUNTER_COUNT; i++)
+		{
+			snapshot.counters[i] += shard->counters[i].load(std::memory_order_relaxed);
+		}
+
+		for (size_t i = 0; i < HISTOGRAM_COUNT; i++)
+		{
+			const HISTOGRAM &histogram = shard->histograms[i];
+			HISTOGRAM_SNAPSHOT &total = snapshot.histograms[i];
+			total.count += histogram.count.load(std::memory_order_relaxed);
+			total.sum += histogram.sum.load(std::memory_order_relaxed);
+			total.max = std::max(total.max, histogram.max.load(std::memory_order_relaxed));
+			for (uint32_t j = 0; j < BUCKET_COUNT; j++)
+			{
+				total.buckets[j] += histogram.buckets[j].load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	return snapshot;
+}
+
+bool Metrics::Save(const std::wstring &file)
+{
+	// Too big for the stack of the tray threads to hold comfortably.
+	const std::unique_ptr<const SNAPSHOT> snapshot = std::make_unique<const SNAPSHOT>(Snapshot());
+
+	const uint64_t uptime = ToMicroseconds(Now() - m_Start);
+	const uint64_t ticks = snapshot->counters[static_cast<uint32_t>(Counter::Ticks)];
+
+	std::ostringstream json;
+	json << "{\n\"uptime_us\":" << uptime << ",\n\"derived\":{";
+
+	// What matters for battery life, precomputed so that runs of different lengths compare directly.
+	json << "\n\"wakeups_per_second\":" << (uptime != 0 ? snapshot->counters[static_cast<uint32_t>(Counter::Wakeups)] * 1000000.0 / uptime : 0.0);
+	json << ",\n\"idle_tick_fraction\":" << (ticks != 0 ? static_cast<double>(snapshot->counters[static_cast<uint32_t>(Counter::IdleTicks)]) / ticks : 0.0);
+	json << ",\n\"cpu_us_per_tick\":" << (ticks != 0 ? static_cast<double>(snapshot->counters[static_cast<uint32_t>(Counter::WorkerCpuTime)]) / ticks : 0.0);
+	json << "\n},\n\"counters\":{";
+	for (size_t i = 0; i < COUNTER_COUNT; i++)
+	{
+		json << (i == 0 ? "\n" : ",\n") << '"' << COUNTER_NAMES[i] << "\":" << snapshot->counters[i];
+	}
+
+	json << "\n},\n\"histograms\":{";
+	for (size_t i = 0; i < HISTOGRAM_COUNT; i++)
+	{
+		const HISTOGRAM_SNAPSHOT &histogram = snapshot->histograms[i];
+		json << (i == 0 ? "\n" : ",\n") << '"' << HISTOGRAM_NAMES[i] << "\":{";
+		json << "\"count\":" << histogram.count << ",\"sum\":" << histogram.sum << ",\"max\":" << histogram.max;
+		json << ",\"p50\":" << histogram.percentile(0.5) << ",\"p90\":" << histogram.percentile(0.9) << ",\"p99\":" << histogram.percentile(0.99);
+
+		// As [lower bound, count] pairs
+		json << ",\"buckets\":[";
+		bool first = true;
+		for (uint32_t j = 0; j < BUCKET_COUNT; j++)
+		{
+			if (histogram.buckets[j] != 0)
+			{
+				json << (first ? "" : ",") << '[' << BucketLowerBound(j) << ',' << histogram.buckets[j] << ']';
+				first = false;
+			}
+		}
+		json << "]}";
+	}
+	json << "\n}\n}\n";
+
+	const std::string text = json.str();
+	return win32::WriteFileAtomically(file, text.data(), text.size());
+}
\ No newline at end of file
@@ -0,0 +1,268 @@
+#pragma once
+#include "arch.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <intrin.h>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <profileapi.h>
+#include <string>
+#include <vector>
+#include <windef.h>
+
+// Always on counters and latency histograms. Every thread updates its own shard, so recording never contends,
+// and a snapshot sums the shards of all threads that ever recorded something.
+class Metrics {
+
+public:
+	// Only append to these, and keep the names below in the same order.
+	enum class Counter : uint32_t {
+		Ticks,
+		Enumerations,
+		WindowsInspected,
+		TitleCacheHits,
+		TitleCacheMisses,
+		ClassNameCacheHits,
+		ClassNameCacheMisses,
+		FileNameCacheHits,
+		FileNameCacheMisses,
+		BlacklistCacheHits,
+		BlacklistCacheMisses,
+		CompositionCalls,
+		CompositionSkipped,
+		ThemeChangedSent,
+		HookEvents,
+		Wakeups,
+		IdleTicks,		// Ticks that left every taskbar as it was
+		WorkerCpuTime	// Microseconds, coarse but doesn't drift
+	};
+
+	// Latencies go from the event that should change the taskbar to when the worker applied it.
+	enum class Histogram : uint32_t {
+		TickDuration,
+		StartLatency,
+		ForegroundLatency,
+		MaximisedLatency,
+		PeekLatency,
+		TickCpuCycles
+	};
+
+	static constexpr const char *COUNTER_NAMES[] = {
+		"ticks",
+		"enumerations",
+		"windows_inspected",
+		"title_cache_hits",
+		"title_cache_misses",
+		"class_name_cache_hits",
+		"class_name_cache_misses",
+		"file_name_cache_hits",
+		"file_name_cache_misses",
+		"blacklist_cache_hits",
+		"blacklist_cache_misses",
+		"composition_calls",
+		"composition_skipped",
+		"theme_changed_sent",
+		"hook_events",
+		"wakeups",
+		"idle_ticks",
+		"worker_cpu_us"
+	};
+
+	// Suffixed with their unit.
+	static constexpr const char *HISTOGRAM_NAMES[] = {
+		"tick_duration_us",
+		"start_latency_us",
+		"foreground_latency_us",
+		"maximised_latency_us",
+		"peek_latency_us",
+		"tick_cpu_cycles"
+	};
+
+	static constexpr size_t COUNTER_COUNT = std::size(COUNTER_NAMES);
+	static constexpr size_t HISTOGRAM_COUNT = std::size(HISTOGRAM_NAMES);
+
+	// Log-linear buckets: values under 4 get their own bucket, then every power of two is split in 4.
+	static constexpr uint32_t SUB_BUCKET_BITS = 2;
+	static constexpr uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+	static constexpr uint32_t BUCKET_COUNT = SUB_BUCKETS + (64 - SUB_BUCKET_BITS) * SUB_BUCKETS;
+
+	struct HISTOGRAM_SNAPSHOT {
+		uint64_t count;
+		uint64_t sum;
+		uint64_t max;
+		uint64_t buckets[BUCKET_COUNT];
+
+		// Upper bound of the bucket holding the value at this fraction of the recorded values.
+		uint64_t percentile(const double &fraction) const;
+	};
+
+	struct SNAPSHOT {
+		uint64_t counters[COUNTER_COUNT];
+		HISTOGRAM_SNAPSHOT histograms[HISTOGRAM_COUNT];
+	};
+
+	// Origins of the events a tick is applying, by latency histogram. Zero when there is none.
+	struct EVENTS {
+		uint64_t origins[HISTOGRAM_COUNT];
+	};
+
+private:
+	struct HISTOGRAM {
+		std::atomic<uint64_t> count;
+		std::atomic<uint64_t> sum;
+		std::atomic<uint64_t> max;
+		std::atomic<uint64_t> buckets[BUCKET_COUNT];
+	};
+
+	struct SHARD {
+		std::atomic<uint64_t> counters[COUNTER_COUNT];
+		HISTOGRAM histograms[HISTOGRAM_COUNT];
+	};
+
+	static std::mutex m_ShardsLock;
+	static std::vector<std::unique_ptr<SHARD>> m_Shards;
+	static uint64_t m_Frequency;
+	static uint64_t m_Start;
+
+	// Events that happened since the worker last took them. Only the oldest one counts.
+	static std::atomic<uint64_t> m_PendingEvents[HISTOGRAM_COUNT];
+
+	static SHARD &CreateShard();
+
+	inline static SHARD &GetShard()
+	{
+		thread_local SHARD &shard = CreateShard();
+		return shard;
+	}
+
+	// Only the owning thread writes to a shard, so this doesn't need a locked instruction.
+	inline static void Add(std::atomic<uint64_t> &value, const uint64_t &amount)
+	{
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	inline static uint32_t HighestBit(const uint64_t &value)
+	{
+		unsigned long index;
+		if (_BitScanReverse(&index, static_cast<unsigned long>(value >> 32)))
+		{
+			return index + 32;
+		}
+		else
+		{
+			_BitScanReverse(&index, static_cast<unsigned long>(value));
+			return index;
+		}
+	}
+
+public:
+	class Timer {
+
+	private:
+		Histogram m_Histogram;
+		uint64_t m_Start;
+
+	public:
+		inline explicit Timer(const Histogram &histogram) : m_Histogram(histogram), m_Start(Now()) { }
+
+		inline ~Timer()
+		{
+			Record(m_Histogram, ToMicroseconds(Now() - m_Start));
+		}
+
+		Timer(const Timer &) = delete;
+		Timer &operator =(const Timer &) = delete;
+	};
+
+	// Measures the CPU time of the calling thread. Cycles are precise enough for a single tick, while
+	// thread times only advance with the clock interrupt but add up to the real total.
+	class CpuTimer {
+
+	private:
+		Histogram m_Cycles;
+		Counter m_Time;
+		uint64_t m_StartCycles;
+		uint64_t m_StartTime;
+
+	public:
+		inline CpuTimer(const Histogram &cycles, const Counter &time) : m_Cycles(cycles), m_Time(time), m_StartCycles(ThreadCycles()), m_StartTime(ThreadTime()) { }
+
+		inline ~CpuTimer()
+		{
+			Record(m_Cycles, ThreadCycles() - m_StartCycles);
+			Increment(m_Time, (ThreadTime() - m_StartTime) / 10);
+		}
+
+		CpuTimer(const CpuTimer &) = delete;
+		CpuTimer &operator =(const CpuTimer &) = delete;
+	};
+
+	static uint64_t ThreadCycles();
+	static uint64_t ThreadTime();	// Hundreds of nanoseconds, user and kernel
+
+	inline static uint64_t Now()
+	{
+		LARGE_INTEGER ticks;
+		QueryPerformanceCounter(&ticks);
+		return static_cast<uint64_t>(ticks.QuadPart);
+	}
+
+	inline static uint64_t ToMicroseconds(const uint64_t &ticks)
+	{
+		// Split so that the multiplication can't overflow, which it would after a few weeks of ticks.
+		return ticks / m_Frequency * 1000000 + ticks % m_Frequency * 1000000 / m_Frequency;
+	}
+
+	inline static uint32_t BucketIndex(const uint64_t &value)
+	{
+		if (value < SUB_BUCKETS)
+		{
+			return static_cast<uint32_t>(value);
+		}
+
+		const uint32_t exponent = HighestBit(value);
+		const uint32_t mantissa = static_cast<uint32_t>(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+		return SUB_BUCKETS + (exponent - SUB_BUCKET_BITS) * SUB_BUCKETS + mantissa;
+	}
+
+	static uint64_t BucketLowerBound(const uint32_t &index);
+
+	inline static void Increment(const Counter &counter, const uint64_t &amount = 1)
+	{
+		Add(GetShard().counters[static_cast<uint32_t>(counter)], amount);
+	}
+
+	inline static void Record(const Histogram &histogram, const uint64_t &value)
+	{
+		HISTOGRAM &shard = GetShard().histograms[static_cast<uint32_t>(histogram)];
+		Add(shard.count, 1);
+		Add(shard.sum, value);
+		Add(shard.buckets[BucketIndex(value)], 1);
+		if (value > shard.max.load(std::memory_order_relaxed))
+		{
+			shard.max.store(value, std::memory_order_relaxed);
+		}
+	}
+
+	// Converts the timestamp of a WinEvent to a performance counter value, so it can be an event's origin.
+	static uint64_t FromEventTime(const DWORD &event_time);
+
+	// Called by whoever notices an event. Thread safe.
+	inline static void EventOccurred(const Histogram &latency, const uint64_t &origin = Now())
+	{
+		uint64_t none = 0;
+		m_PendingEvents[static_cast<uint32_t>(latency)].compare_exchange_strong(none, origin, std::memory_order_relaxed);
+	}
+
+	// Called by the worker before it reads the state the events changed, and once it applied the new state.
+	// Events that occur in between are left for the next time.
+	static EVENTS TakeEvents();
+	static void EventsApplied(const EVENTS &events, const uint64_t &now = Now());
+
+	static SNAPSHOT Snapshot();
+
+	// Writes a snapshot as JSON, with the percentiles of each histogram and its non-empty buckets.
+	static bool Save(const std::wstring &file);
+};
\ No newline at end of file
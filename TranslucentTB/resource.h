@@ -56,3 +56,6 @@
 #define IDM_AUTOSTART                   40052
 #define IDM_TIPS                        40053
 #define IDM_EXIT                        40054
+#define IDM_DUMPBLACKLISTSTATS          40055
+#define IDM_SAVETRACE                   40056
+#define IDM_SAVEMETRICS                 40057
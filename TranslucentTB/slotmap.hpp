@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Stores values behind keys that stay valid until the value is erased, and aren't reused after:
+// each slot counts how many times it was freed, and keys carry that generation.
+// Inserting and erasing are O(1), and iteration goes over the slots in order.
+template<typename T>
+class SlotMap {
+
+public:
+	// Never 0, so that 0 can be used as an invalid key.
+	using key_type = uint64_t;
+
+private:
+	static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+	struct SLOT {
+		uint32_t generation;
+		uint32_t next_free;
+		std::optional<T> value;
+	};
+
+	std::vector<SLOT> m_Slots;
+	uint32_t m_FreeHead = NO_SLOT;
+	std::size_t m_Size = 0;
+
+	inline static key_type MakeKey(const uint32_t &index, const uint32_t &generation)
+	{
+		return (static_cast<key_type>(generation) << 32) | index;
+	}
+
+	inline const SLOT *GetSlot(const key_type &key) const
+	{
+		const uint32_t index = static_cast<uint32_t>(key);
+		if (index < m_Slots.size())
+		{
+			const SLOT &slot = m_Slots[index];
+			if (slot.value && slot.generation == static_cast<uint32_t>(key >> 32))
+			{
+				return &slot;
+			}
+		}
+
+		return nullptr;
+	}
+
+public:
+	inline key_type insert(T value)
+	{
+		uint32_t index;
+		if (m_FreeHead != NO_SLOT)
+		{
+			index = m_FreeHead;
+			m_FreeHead = m_Slots[index].next_free;
+		}
+		else
+		{
+			index = static_cast<uint32_t>(m_Slots.size());
+			m_Slots.push_back({ 1, NO_SLOT, std::nullopt });
+		}
+
+		SLOT &slot = m_Slots[index];
+		slot.value.emplace(std::move(value));
+		m_Size++;
+		return MakeKey(index, slot.generation);
+	}
+
+	inline bool erase(const key_type &key)
+	{
+		if (!GetSlot(key))
+		{
+			return false;
+		}
+
+		const uint32_t index = static_cast<uint32_t>(key);
+		SLOT &slot = m_Slots[index];
+		slot.value.reset();
+
+		// 0 is skipped to keep keys non-zero.
+		if (++slot.generation == 0)
+		{
+			slot.generation = 1;
+		}
+
+		slot.next_free = m_FreeHead;
+		m_FreeHead = index;
+		m_Size--;
+		return true;
+	}
+
+	inline T *find(const key_type &key)
+	{
+		const SLOT *slot = GetSlot(key);
+		return slot ? &*m_Slots[static_cast<uint32_t>(key)].value : nullptr;
+	}
+
+	inline const T *find(const key_type &key) const
+	{
+		const SLOT *slot = GetSlot(key);
+		return slot ? &*slot->value : nullptr;
+	}
+
+	inline std::size_t size() const
+	{
+		return m_Size;
+	}
+
+	// Calls the function with the key and value of every element.
+	template<typename Function>
+	inline void for_each(Function &&function)
+	{
+		for (uint32_t i = 0; i < m_Slots.size(); i++)
+		{
+			SLOT &slot = m_Slots[i];
+			if (slot.value)
+			{
+				function(MakeKey(i, slot.generation), *slot.value);
+			}
+		}
+	}
+};
\ No newline at end of file
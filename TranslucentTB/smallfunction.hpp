@@ -0,0 +1,122 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature>
+class SmallFunction;
+
+// A move only std::function that stores its callable inline, so it never allocates.
+// Callables bigger than a few pointers don't compile, capture a pointer to the state instead.
+template<typename R, typename... Args>
+class SmallFunction<R(Args...)> {
+
+private:
+	static constexpr std::size_t BUFFER_SIZE = 4 * sizeof(void *);
+
+	template<typename T>
+	static constexpr bool FITS = sizeof(T) <= BUFFER_SIZE && alignof(T) <= alignof(std::max_align_t);
+
+	struct VTABLE {
+		R (*invoke)(void *storage, Args... args);
+		void (*move)(void *from, void *to);	// Leaves from empty
+		void (*destroy)(void *storage);
+	};
+
+	template<typename T>
+	inline static T *Get(void *storage)
+	{
+		return std::launder(reinterpret_cast<T *>(storage));
+	}
+
+	template<typename T>
+	inline static R Invoke(void *storage, Args... args)
+	{
+		return (*Get<T>(storage))(std::forward<Args>(args)...);
+	}
+
+	template<typename T>
+	inline static void Move(void *from, void *to)
+	{
+		new (to) T(std::move(*Get<T>(from)));
+		Get<T>(from)->~T();
+	}
+
+	template<typename T>
+	inline static void Destroy(void *storage)
+	{
+		Get<T>(storage)->~T();
+	}
+
+	template<typename T>
+	static constexpr VTABLE VTABLE_FOR = { &Invoke<T>, &Move<T>, &Destroy<T> };
+
+	alignas(std::max_align_t) unsigned char m_Storage[BUFFER_SIZE];
+	const VTABLE *m_VTable;
+
+	inline void Reset()
+	{
+		if (m_VTable)
+		{
+			m_VTable->destroy(m_Storage);
+			m_VTable = nullptr;
+		}
+	}
+
+public:
+	// constexpr so that arrays of them with static storage duration are constant initialized.
+	inline constexpr SmallFunction() noexcept : m_Storage(), m_VTable(nullptr) { }
+
+	template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, SmallFunction> && std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>>
+	inline SmallFunction(F &&callable) : m_VTable(&VTABLE_FOR<std::decay_t<F>>)
+	{
+		using T = std::decay_t<F>;
+		static_assert(FITS<T>, "Callable is too big for SmallFunction.");
+		static_assert(std::is_nothrow_move_constructible_v<T>, "SmallFunction requires callables that can be moved without throwing.");
+
+		new (m_Storage) T(std::forward<F>(callable));
+	}
+
+	inline SmallFunction(SmallFunction &&other) noexcept : m_VTable(std::exchange(other.m_VTable, nullptr))
+	{
+		if (m_VTable)
+		{
+			m_VTable->move(other.m_Storage, m_Storage);
+		}
+	}
+
+	inline SmallFunction &operator =(SmallFunction &&other) noexcept
+	{
+		if (this != &other)
+		{
+			Reset();
+			m_VTable = std::exchange(other.m_VTable, nullptr);
+			if (m_VTable)
+			{
+				m_VTable->move(other.m_Storage, m_Storage);
+			}
+		}
+
+		return *this;
+	}
+
+	SmallFunction(const SmallFunction &) = delete;
+	SmallFunction &operator =(const SmallFunction &) = delete;
+
+	inline ~SmallFunction()
+	{
+		Reset();
+	}
+
+	inline explicit operator bool() const noexcept
+	{
+		return m_VTable != nullptr;
+	}
+
+	inline R operator ()(Args... args) const
+	{
+		// The callable itself can be mutable, like a std::function.
+		return m_VTable->invoke(const_cast<unsigned char *>(m_Storage), std::forward<Args>(args)...);
+	}
+};
\ No newline at end of file
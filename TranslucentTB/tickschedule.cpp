@@ -0,0 +1,31 @@
+#include "tickschedule.hpp"
+
+bool TickSchedule::Begin(const bool &force)
+{
+	Metrics::Increment(Metrics::Counter::Ticks);
+	if (m_Counter >= m_EvaluateEvery || force)
+	{
+		m_Events = Metrics::TakeEvents();
+		m_Counter = 0;
+		return true;
+	}
+	else
+	{
+		m_Events = { };
+		m_Counter++;
+		return false;
+	}
+}
+
+void TickSchedule::End(const bool &changed, const uint64_t &now)
+{
+	// Re-evaluations that end up applying the same accent didn't handle anything, so they aren't a latency.
+	if (changed)
+	{
+		Metrics::EventsApplied(m_Events, now);
+	}
+	else
+	{
+		Metrics::Increment(Metrics::Counter::IdleTicks);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+
+#include "metrics.hpp"
+
+// Decides which ticks of the worker read the desktop again, and accounts for what each tick did.
+// The scheduling benchmark drives it with simulated time, so per tick policy belongs in here.
+class TickSchedule {
+
+private:
+	uint32_t m_EvaluateEvery;
+	uint32_t m_Counter;
+	Metrics::EVENTS m_Events;
+
+public:
+	// The desktop is read again once this many ticks went by without doing so.
+	inline explicit TickSchedule(const uint32_t &evaluate_every) :
+		m_EvaluateEvery(evaluate_every),
+		m_Counter(evaluate_every),
+		m_Events()
+	{ }
+
+	// Returns true when this tick should read the desktop again, always the case when forced.
+	// The events noticed until then are taken, and belong to this tick.
+	bool Begin(const bool &force);
+
+	// Records the latency of the events taken by Begin if a taskbar changed, or counts an idle tick if none did.
+	void End(const bool &changed, const uint64_t &now = Metrics::Now());
+};
\ No newline at end of file
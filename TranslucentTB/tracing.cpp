@@ -0,0 +1,132 @@
+#include "tracing.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <processthreadsapi.h>
+#include <sstream>
+
+#include "win32.hpp"
+
+std::mutex Trace::m_RingsLock;
+std::vector<std::unique_ptr<Trace::RING>> Trace::m_Rings;
+
+Trace::RingLease::RingLease() : m_Ring(nullptr)
+{
+	std::lock_guard guard(m_RingsLock);
+	for (const std::unique_ptr<RING> &ring : m_Rings)
+	{
+		if (!ring->in_use.load(std::memory_order_relaxed))
+		{
+			// The spans of the previous thread stay, they are tagged with its ID.
+			ring->in_use.store(true, std::memory_order_relaxed);
+			m_Ring = ring.get();
+			return;
+		}
+	}
+
+	// Past this, threads aren't traced.
+	if (m_Rings.size() < MAX_RINGS)
+	{
+		m_Ring = m_Rings.emplace_back(std::make_unique<RING>()).get();
+		m_Ring->in_use.store(true, std::memory_order_relaxed);
+	}
+}
+
+Trace::RingLease::~RingLease()
+{
+	if (m_Ring)
+	{
+		std::lock_guard guard(m_RingsLock);
+		m_Ring->in_use.store(false, std::memory_order_relaxed);
+	}
+}
+
+void Trace::Record(const char *name, const uint64_t &start, const uint64_t &end)
+{
+	thread_local const RingLease lease;
+	if (RING *const ring = lease.get())
+	{
+		const uint64_t position = ring->position.load(std::memory_order_relaxed);
+
+		// Pairs with the fence in Save: if it sees any of the stores below, it also sees the position,
+		// and knows that the slot is being overwritten.
+		std::atomic_thread_fence(std::memory_order_release);
+
+		SPAN &span = ring->spans[position & (RING_SIZE - 1)];
+		span.name.store(name, std::memory_order_relaxed);
+		span.start.store(start, std::memory_order_relaxed);
+		span.duration.store(static_cast<uint32_t>(std::min<uint64_t>(end - start, UINT32_MAX)), std::memory_order_relaxed);
+		span.thread_id.store(GetCurrentThreadId(), std::memory_order_relaxed);
+
+		ring->position.store(position + 1, std::memory_order_release);
+	}
+}
+
+bool Trace::Save(const std::wstring &file, const uint32_t &seconds)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	const double microseconds_per_tick = 1000000.0 / frequency.QuadPart;
+	const uint64_t now = Now();
+	const uint64_t since = now - std::min<uint64_t>(now, seconds * static_cast<uint64_t>(frequency.QuadPart));
+
+	struct SPAN_COPY {
+		const char *name;
+		uint64_t start;
+		uint32_t duration;
+		DWORD thread_id;
+	};
+
+	// Copy first, the traced threads keep writing meanwhile.
+	std::vector<SPAN_COPY> spans;
+	{
+		std::lock_guard guard(m_RingsLock);
+		for (const std::unique_ptr<RING> &ring : m_Rings)
+		{
+			const uint64_t end = ring->position.load(std::memory_order_acquire);
+			const uint64_t begin = end - std::min<uint64_t>(end, RING_SIZE);
+			const size_t copied = spans.size();
+			for (uint64_t i = begin; i != end; i++)
+			{
+				const SPAN &span = ring->spans[i & (RING_SIZE - 1)];
+				spans.push_back({
+					span.name.load(std::memory_order_relaxed),
+					span.start.load(std::memory_order_relaxed),
+					span.duration.load(std::memory_order_relaxed),
+					span.thread_id.load(std::memory_order_relaxed)
+				});
+			}
+
+			// The span being written when we looked again overwrites the one RING_SIZE before it,
+			// so anything older than that may be torn.
+			std::atomic_thread_fence(std::memory_order_acquire);
+			const uint64_t written = ring->position.load(std::memory_order_relaxed);
+			const uint64_t first_valid = written + 1 > RING_SIZE ? written + 1 - RING_SIZE : 0;
+			if (first_valid > begin)
+			{
+				const size_t torn = static_cast<size_t>(std::min(first_valid, end) - begin);
+				spans.erase(spans.begin() + copied, spans.begin() + copied + torn);
+			}
+		}
+	}
+
+	spans.erase(std::remove_if(spans.begin(), spans.end(), [since](const SPAN_COPY &span)
+	{
+		return span.start + span.duration < since;
+	}), spans.end());
+
+	std::ostringstream trace;
+	trace << std::fixed << std::setprecision(3) << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	const DWORD pid = GetCurrentProcessId();
+	bool first = true;
+	for (const SPAN_COPY &span : spans)
+	{
+		trace << (first ? "\n" : ",\n");
+		trace << "{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << span.thread_id;
+		trace << ",\"ts\":" << static_cast<int64_t>(span.start - since) * microseconds_per_tick << ",\"dur\":" << span.duration * microseconds_per_tick << '}';
+		first = false;
+	}
+	trace << "\n]}\n";
+
+	const std::string json = trace.str();
+	return win32::WriteFileAtomically(file, json.data(), json.size());
+}
\ No newline at end of file
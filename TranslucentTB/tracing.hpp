@@ -0,0 +1,96 @@
+#pragma once
+#include "arch.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <profileapi.h>
+#include <string>
+#include <vector>
+#include <windef.h>
+
+// Records how long scopes take into per-thread rings, so that the last seconds can be saved as a Chrome trace
+// (chrome://tracing or ui.perfetto.dev). Building with NO_TRACING compiles the spans out entirely.
+class Trace {
+
+private:
+	struct SPAN {
+		std::atomic<const char *> name;	// Always a literal
+		std::atomic<uint64_t> start;	// Performance counter value
+		std::atomic<uint32_t> duration;	// Ticks, saturated
+		std::atomic<DWORD> thread_id;	// Rings outlive their thread and get reused
+	};
+
+	// Must be a power of two. Each thread keeps its latest spans, older ones get overwritten.
+	static constexpr uint32_t RING_SIZE = 16384;
+	static constexpr size_t MAX_RINGS = 64;
+
+	// Only written by the thread using it. Saving copies the spans without stopping the writer,
+	// then drops the ones it may have overwritten during the copy.
+	struct RING {
+		std::atomic<bool> in_use;
+		std::atomic<uint64_t> position;	// Spans written so far
+		SPAN spans[RING_SIZE];
+	};
+
+	// Holds a ring for the lifetime of a thread, and gives it back for the next thread when it exits.
+	class RingLease {
+
+	private:
+		RING *m_Ring;
+
+	public:
+		RingLease();
+		~RingLease();
+
+		inline RING *get() const
+		{
+			return m_Ring;
+		}
+
+		RingLease(const RingLease &) = delete;
+		RingLease &operator =(const RingLease &) = delete;
+	};
+
+	static std::mutex m_RingsLock;
+	static std::vector<std::unique_ptr<RING>> m_Rings;
+
+public:
+	class Scope {
+
+	private:
+		const char *m_Name;
+		uint64_t m_Start;
+
+	public:
+		inline explicit Scope(const char *name) : m_Name(name), m_Start(Now()) { }
+
+		inline ~Scope()
+		{
+			Record(m_Name, m_Start, Now());
+		}
+
+		Scope(const Scope &) = delete;
+		Scope &operator =(const Scope &) = delete;
+	};
+
+	inline static uint64_t Now()
+	{
+		LARGE_INTEGER ticks;
+		QueryPerformanceCounter(&ticks);
+		return static_cast<uint64_t>(ticks.QuadPart);
+	}
+
+	static void Record(const char *name, const uint64_t &start, const uint64_t &end);
+
+	// Writes the spans that ended during the last seconds to a file, in the Chrome trace event format.
+	static bool Save(const std::wstring &file, const uint32_t &seconds);
+};
+
+#ifndef NO_TRACING
+#define TRACE_CONCAT_INNER(x, y) x##y
+#define TRACE_CONCAT(x, y) TRACE_CONCAT_INNER(x, y)
+#define TraceScope(name) const Trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+#else
+#define TraceScope(name) ((void)0)
+#endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "traycontextmenu.hpp"
 
+#include "common.hpp"
 #include "ttberror.hpp"
 #include "ttblog.hpp"
 
@@ -7,9 +8,10 @@ long TrayContextMenu::TrayCallback(WPARAM, LPARAM lParam)
 {
 	if (lParam == WM_LBUTTONUP || lParam == WM_RBUTTONUP)
 	{
+		RefreshBindings();
 		for (const auto &refreshFunction : m_RefreshFunctions)
 		{
-			refreshFunction();
+			refreshFunction(m_Menu);
 		}
 
 		POINT pt;
@@ -31,20 +33,72 @@ long TrayContextMenu::TrayCallback(WPARAM, LPARAM lParam)
 			return 0;
 		}
 
-		const auto &callbackVector = m_MenuCallbackMap[item];
-		if (callbackVector.size() > 0)
+		// Clicks are rare, going through every callback is cheaper than keeping an index by item.
+		bool handled = false;
+		m_MenuCallbacks.for_each([item, &handled](MENUCALLBACKCOOKIE, const MENU_CALLBACK &callback)
 		{
-			for (const auto &[_, callback] : callbackVector)
+			if (callback.item == item)
 			{
-				callback();
+				callback.callback();
+				handled = true;
 			}
+		});
+
+		if (handled)
+		{
+			NotifyChange();
 		}
 	}
 	return 0;
 }
 
+long TrayContextMenu::ColorCallback(WPARAM wParam, LPARAM lParam)
+{
+	// Anyone can send us this message, so only trust the item ID.
+	const auto binding = m_ColorBindings.find(static_cast<unsigned int>(lParam));
+	if (binding != m_ColorBindings.end())
+	{
+		*binding->second = static_cast<uint32_t>(wParam);
+		NotifyChange();
+	}
+
+	return 0;
+}
+
+void TrayContextMenu::RefreshBindings()
+{
+	for (auto &binding : m_BoolBindings)
+	{
+		const bool value = binding.value();
+		if (binding.shown != value)
+		{
+			RefreshBool(binding.item, m_Menu, value, binding.effect);
+			binding.shown = value;
+		}
+	}
+
+	for (auto &binding : m_EnumBindings)
+	{
+		const unsigned int position = binding.position();
+		if (binding.shown != position)
+		{
+			RefreshEnum(m_Menu, binding.first, binding.last, position);
+			binding.shown = position;
+		}
+	}
+}
+
+void TrayContextMenu::NotifyChange()
+{
+	for (const auto &callback : m_ChangeCallbacks)
+	{
+		callback();
+	}
+}
+
 TrayContextMenu::TrayContextMenu(MessageWindow &window, wchar_t *iconResource, wchar_t *menuResource, const HINSTANCE &hInstance) :
-	TrayIcon(window, iconResource, 0, hInstance)
+	TrayIcon(window, iconResource, 0, hInstance),
+	m_ColorMessage(RegisterWindowMessage(WM_COLORCHANGED))
 {
 	m_Menu = LoadMenu(hInstance, menuResource);
 	if (!m_Menu)
@@ -52,12 +106,20 @@ TrayContextMenu::TrayContextMenu(MessageWindow &window, wchar_t *iconResource, w
 		LastErrorHandle(Error::Level::Fatal, L"Failed to load context menu.");
 	}
 
-	m_Cookie = RegisterTrayCallback(std::bind(&TrayContextMenu::TrayCallback, this, std::placeholders::_1, std::placeholders::_2));
+	m_Cookie = RegisterTrayCallback([this](WPARAM wParam, LPARAM lParam)
+	{
+		return TrayCallback(wParam, lParam);
+	});
+	m_ColorCookie = m_Window.RegisterCallback(m_ColorMessage, [this](WPARAM wParam, LPARAM lParam)
+	{
+		return ColorCallback(wParam, lParam);
+	});
 }
 
 TrayContextMenu::~TrayContextMenu()
 {
 	m_Window.UnregisterCallback(m_Cookie);
+	m_Window.UnregisterCallback(m_ColorCookie);
 	if (!DestroyMenu(m_Menu))
 	{
 		LastErrorHandle(Error::Level::Log, L"Failed to destroy menu");
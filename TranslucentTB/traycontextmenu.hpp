@@ -1,10 +1,16 @@
 #pragma once
 #include "arch.h"
 #include <algorithm>
+#include <optional>
 #include <string>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include <windef.h>
 
+#include "slotmap.hpp"
+#include "smallfunction.hpp"
 #include "trayicon.hpp"
 #include "util.hpp"
 #include "win32.hpp"
@@ -12,46 +18,43 @@
 class TrayContextMenu : public TrayIcon {
 
 protected:
-	using callback_t = std::function<void()>;
+	using callback_t = SmallFunction<void()>;
+	using refresh_t = SmallFunction<void(HMENU menu)>;
 
 private:
+	struct MENU_CALLBACK {
+		unsigned int item;
+		callback_t callback;
+	};
+
 	HMENU m_Menu;
-	std::unordered_map<unsigned int, std::vector<std::pair<unsigned short, callback_t>>> m_MenuCallbackMap;
+	SlotMap<MENU_CALLBACK> m_MenuCallbacks;
 	long TrayCallback(WPARAM, LPARAM);
 	MessageWindow::CALLBACKCOOKIE m_Cookie;
 
-	std::vector<std::function<void()>> m_RefreshFunctions;
+	std::vector<refresh_t> m_RefreshFunctions;
+
+	const unsigned int m_ColorMessage;
+	std::unordered_map<unsigned int, uint32_t *> m_ColorBindings;
+	long ColorCallback(WPARAM wParam, LPARAM lParam);
+	MessageWindow::CALLBACKCOOKIE m_ColorCookie;
+
+	std::vector<callback_t> m_ChangeCallbacks;
+	void NotifyChange();
 
 public:
 	TrayContextMenu(MessageWindow &window, wchar_t *iconResource, wchar_t *menuResource, const HINSTANCE &hInstance = GetModuleHandle(NULL));
 
-	using MENUCALLBACKCOOKIE = unsigned long long;
+	using MENUCALLBACKCOOKIE = SlotMap<MENU_CALLBACK>::key_type;
 
-	inline MENUCALLBACKCOOKIE RegisterContextMenuCallback(unsigned int item, const callback_t &callback)
+	inline MENUCALLBACKCOOKIE RegisterContextMenuCallback(unsigned int item, callback_t callback)
 	{
-		unsigned short secret = Util::GetRandomNumber<unsigned short>();
-		m_MenuCallbackMap[item].emplace_back(secret, callback);
-
-		return (static_cast<MENUCALLBACKCOOKIE>(secret) << 32) + item;
+		return m_MenuCallbacks.insert({ item, std::move(callback) });
 	}
 
 	inline bool UnregisterContextMenuCallback(MENUCALLBACKCOOKIE cookie)
 	{
-		unsigned int item = cookie & 0xFFFFFFFF;
-		unsigned short secret = (cookie >> 32) & 0xFFFF;
-
-		auto &callbackVector = m_MenuCallbackMap[item];
-		for (auto &callbackPair : callbackVector)
-		{
-			if (callbackPair.first == secret)
-			{
-				std::swap(callbackPair, callbackVector.back());
-				callbackVector.pop_back();
-				return true;
-			}
-		}
-
-		return false;
+		return m_MenuCallbacks.erase(cookie);
 	}
 
 	enum BoolBindingEffect {
@@ -59,6 +62,29 @@ public:
 		ControlsEnabled
 	};
 
+private:
+	// Bound items remember what they last showed, so opening the menu only touches
+	// the items whose value changed since, however the value was changed.
+	struct BOOL_BINDING {
+		unsigned int item;
+		SmallFunction<bool()> value;
+		BoolBindingEffect effect;
+		std::optional<bool> shown;
+	};
+
+	struct ENUM_BINDING {
+		unsigned int first;
+		unsigned int last;
+		SmallFunction<unsigned int()> position;
+		std::optional<unsigned int> shown;
+	};
+
+	std::vector<BOOL_BINDING> m_BoolBindings;
+	std::vector<ENUM_BINDING> m_EnumBindings;
+	void RefreshBindings();
+
+public:
+
 	inline static void RefreshBool(unsigned int item, HMENU menu, const bool &value, BoolBindingEffect effect)
 	{
 		if (effect == Toggle)
@@ -88,10 +114,22 @@ public:
 	{
 		if (effect == Toggle)
 		{
-			RegisterContextMenuCallback(item, std::bind(&Util::InvertBool, std::ref(value)));
+			RegisterContextMenuCallback(item, [&value]
+			{
+				Util::InvertBool(value);
+			});
 		}
 
-		m_RefreshFunctions.push_back(std::bind(&TrayContextMenu::RefreshBool, item, m_Menu, std::ref(value), effect));
+		BindBool(item, [&value]
+		{
+			return value;
+		}, effect);
+	}
+
+	// Binds an item to a value computed when the menu is opened.
+	inline void BindBool(unsigned int item, SmallFunction<bool()> value, BoolBindingEffect effect)
+	{
+		m_BoolBindings.push_back({ item, std::move(value), effect, std::nullopt });
 	}
 
 	template<class T>
@@ -100,27 +138,45 @@ public:
 		static_assert(std::is_enum_v<T>, "T is not an enum.");
 		for (const auto &[item_value, item] : map)
 		{
-			RegisterContextMenuCallback(item, std::bind(&Util::UpdateValue<T>, std::ref(value), std::ref(item_value)));
+			RegisterContextMenuCallback(item, [&value, &item_value = item_value]
+			{
+				Util::UpdateValue(value, item_value);
+			});
 		}
 
 		auto [min_p, max_p] = std::minmax_element(map.begin(), map.end(), Util::map_value_compare<T, unsigned int>());
 		unsigned int min = min_p->second;
 		unsigned int max = max_p->second;
 
-		m_RefreshFunctions.emplace_back([this, min, max, &value, &map]
+		m_EnumBindings.push_back({ min, max, [&value, &map]
 		{
-			RefreshEnum(m_Menu, min, max, map.at(value));
-		});
+			return map.at(value);
+		}, std::nullopt });
 	}
 
 	inline void BindColor(unsigned int item, uint32_t &color)
 	{
-		RegisterContextMenuCallback(item, std::bind(&win32::PickColor, std::ref(color)));
+		m_ColorBindings[item] = &color;
+		RegisterContextMenuCallback(item, [window = m_Window.handle(), message = m_ColorMessage, item, &color]
+		{
+			win32::PickColor(color, [window, message, item](uint32_t value)
+			{
+				// The picker runs on its own thread, let the thread owning the color apply it.
+				PostMessage(window, message, value, item);
+			});
+		});
+	}
+
+	// Called after a menu item has been selected, or a bound color has changed.
+	inline void RegisterChangeCallback(callback_t callback)
+	{
+		m_ChangeCallbacks.push_back(std::move(callback));
 	}
 
-	inline void RegisterCustomRefresh(const std::function<void(HMENU menu)> &function)
+	// Called with the menu right before it is shown.
+	inline void RegisterCustomRefresh(refresh_t function)
 	{
-		m_RefreshFunctions.push_back(std::bind(function, m_Menu));
+		m_RefreshFunctions.push_back(std::move(function));
 	}
 
 	~TrayContextMenu();
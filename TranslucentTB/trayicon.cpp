@@ -6,7 +6,7 @@
 #include "ttberror.hpp"
 #include "ttblog.hpp"
 
-long TrayIcon::RegisterIcon(...)
+long TrayIcon::RegisterIcon()
 {
 	if (!Shell_NotifyIcon(NIM_ADD, &m_IconData))
 	{
@@ -36,7 +36,10 @@ TrayIcon::TrayIcon(MessageWindow &window, wchar_t *iconResource, const unsigned
 
 	RegisterIcon();
 
-	m_Cookie = m_Window.RegisterCallback(WM_TASKBARCREATED, std::bind(&TrayIcon::RegisterIcon, this));
+	m_Cookie = m_Window.RegisterCallback(WM_TASKBARCREATED, [this](WPARAM, LPARAM)
+	{
+		return RegisterIcon();
+	});
 }
 
 TrayIcon::~TrayIcon()
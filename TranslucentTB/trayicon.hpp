@@ -6,14 +6,14 @@ class TrayIcon {
 
 protected:
 	MessageWindow &m_Window;
-	inline MessageWindow::CALLBACKCOOKIE RegisterTrayCallback(const std::function<long(WPARAM, LPARAM)> &callback)
+	inline MessageWindow::CALLBACKCOOKIE RegisterTrayCallback(MessageWindow::callback_t callback)
 	{
-		return m_Window.RegisterCallback(m_IconData.uCallbackMessage, callback);
+		return m_Window.RegisterCallback(m_IconData.uCallbackMessage, std::move(callback));
 	}
 
 private:
 	NOTIFYICONDATA m_IconData;
-	long RegisterIcon(...);
+	long RegisterIcon();
 	MessageWindow::CALLBACKCOOKIE m_Cookie;
 
 public:
@@ -1,66 +1,94 @@
 #include "ttberror.hpp"
+#include <algorithm>
 #include <comdef.h>
+#include <cstdlib>
 #include <exception>
-#include <iomanip>
-#include <sstream>
 #include <string>
+#include <thread>
+#include <string_view>
+#include <sysinfoapi.h>
+#include <tuple>
+#include <utility>
 #include <vector>
 #include <winerror.h>
 #include <WinUser.h>
 
-#include "autofree.hpp"
 #include "common.hpp"
+#include "errorformat.hpp"
 #include "ttblog.hpp"
-#include "util.hpp"
 #include "win32.hpp"
 #include "window.hpp"
 
+std::mutex Error::m_BucketsLock;
+std::unordered_map<Error::CALL_SITE, Error::BUCKET, Error::CALL_SITE_HASH> Error::m_Buckets;
+
+std::shared_mutex Error::m_MessagesLock;
+std::unordered_map<HRESULT, std::wstring> Error::m_Messages;
+
+std::shared_mutex Error::m_FunctionsLock;
+std::unordered_map<const char *, std::wstring> Error::m_Functions;
+
+std::once_flag Error::m_DialogThreadFlag;
+std::mutex Error::m_DialogsLock;
+std::condition_variable Error::m_DialogsAvailable;
+std::deque<std::wstring> Error::m_Dialogs;
+std::wstring Error::m_ShownDialog;
+std::atomic<Error::message_box_t> Error::m_MessageBox = &MessageBox;
+
 bool Error::Handle(const HRESULT &error, const Level &level, const wchar_t *const message, const wchar_t *const file, const int &line, const char *const function)
 {
 	if (FAILED(error))
 	{
-		const std::wstring message_str(message);
-		const std::wstring error_message = ExceptionFromHRESULT(error);
-		std::wostringstream boxbuffer;
-		if (level != Level::Log && level != Level::Debug)
+		// Checked before anything gets formatted, so that an error storm only costs a counter increment.
+		if (level == Level::Log || level == Level::Debug)
 		{
-			boxbuffer << message_str << L"\n\n";
-
-			if (level == Level::Fatal)
+			const CALL_SITE site = { file, line, error };
+			uint32_t repeated;
+			const bool output = TakeToken(site, level, repeated);
+			if (repeated != 0)
 			{
-				boxbuffer << L"Program will exit.\n\n";
+				OutputRepeated(site, level, repeated);
 			}
 
-			boxbuffer << error_message;
+			if (!output)
+			{
+				return false;
+			}
 		}
 
 		// https://bugs.llvm.org/show_bug.cgi?id=38295
-		std::wstring functionW = win32::CharToWchar(function);
-		if (functionW.empty())
-		{
-			functionW = L"[failed to convert function name to UTF-16]";
-		}
-
-		std::wostringstream err;
-		err << message_str << L' ' << error_message <<
-			L" (" << file << L':' << line << L" at function " << functionW << L')';
+		const std::wstring_view functionW = WidenFunction(function);
 
 		switch (level)
 		{
 		case Level::Debug:
-			err << L'\n';
-			OutputDebugString(err.str().c_str());
+		{
+			std::wstring &err = ThreadBuffer();
+			err += message;
+			err += L' ';
+			err += CachedExceptionFromHRESULT(error);
+			err += L" (";
+			err += file;
+			err += L':';
+			AppendInteger(err, line);
+			err += L" at function ";
+			err += functionW;
+			err += L")\n";
+			OutputDebugString(err.c_str());
 			break;
+		}
+		// The error is described by whoever formats the message, not by us.
 		case Level::Log:
-			Log::OutputMessage(err.str());
+			Log::Output(BinaryLog::MessageId::Error, message, error, file, line, functionW);
 			break;
 		case Level::Error:
-			Log::OutputMessage(err.str());
-			MessageBox(Window::NullWindow, boxbuffer.str().c_str(), NAME L" - Error", MB_ICONWARNING | MB_OK | MB_SETFOREGROUND);
+			Log::Output(BinaryLog::MessageId::Error, message, error, file, line, functionW);
+			QueueDialog(BoxMessage(level, message, error));
 			break;
 		case Level::Fatal:
-			Log::OutputMessage(err.str());
-			MessageBox(Window::NullWindow, boxbuffer.str().c_str(), NAME L" - Fatal error", MB_ICONERROR | MB_OK | MB_SETFOREGROUND | MB_TOPMOST);
+			Log::Output(BinaryLog::MessageId::Error, message, error, file, line, functionW);
+			Log::Flush();
+			m_MessageBox.load()(Window::NullWindow, BoxMessage(level, message, error).c_str(), NAME L" - Fatal error", MB_ICONERROR | MB_OK | MB_SETFOREGROUND | MB_TOPMOST);
 			RaiseFailFastException(NULL, NULL, FAIL_FAST_GENERATE_EXCEPTION_ADDRESS);	// Calling abort() will generate a dialog box,
 																						// but we already have our own. Raising a fail-fast
 																						// exception skips it but also allows WER to do its
@@ -81,10 +109,206 @@ bool Error::Handle(const HRESULT &error, const Level &level, const wchar_t *cons
 
 std::wstring Error::ExceptionFromHRESULT(const HRESULT &result)
 {
-	AutoFree::SilentLocal<wchar_t> error;
-	const DWORD count = FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS | FORMAT_MESSAGE_MAX_WIDTH_MASK, nullptr, result, MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US), reinterpret_cast<wchar_t *>(error.put()), 0, nullptr);
-	std::wostringstream stream;
-	stream << L"Exception from HRESULT: " << (count ? Util::Trim(error.get()) : L"[failed to get error message for HRESULT]") <<
-		L" (0x" << std::setw(sizeof(HRESULT) * 2) << std::setfill(L'0') << std::hex << result << L')';
-	return stream.str();
+	return ErrorFormat::FromHRESULT(result);
+}
+
+std::wstring_view Error::CachedExceptionFromHRESULT(const HRESULT &result)
+{
+	{
+		std::shared_lock guard(m_MessagesLock);
+		if (const auto it = m_Messages.find(result); it != m_Messages.end())
+		{
+			return it->second;
+		}
+	}
+
+	std::wstring formatted = ExceptionFromHRESULT(result);
+
+	std::unique_lock guard(m_MessagesLock);
+	if (m_Messages.size() < MAX_CACHED_MESSAGES || m_Messages.count(result) != 0)
+	{
+		return m_Messages.try_emplace(result, std::move(formatted)).first->second;
+	}
+	else
+	{
+		// Valid until this thread formats another one.
+		thread_local std::wstring uncached;
+		uncached = std::move(formatted);
+		return uncached;
+	}
+}
+
+void Error::QueueDialog(std::wstring message)
+{
+	std::call_once(m_DialogThreadFlag, []
+	{
+		std::thread(DialogThread).detach();
+	});
+
+	{
+		std::lock_guard guard(m_DialogsLock);
+		if (message == m_ShownDialog || std::find(m_Dialogs.begin(), m_Dialogs.end(), message) != m_Dialogs.end())
+		{
+			return;
+		}
+
+		m_Dialogs.push_back(std::move(message));
+	}
+
+	m_DialogsAvailable.notify_one();
+}
+
+void Error::DialogThread()
+{
+	std::unique_lock guard(m_DialogsLock);
+	while (true)
+	{
+		m_DialogsAvailable.wait(guard, []
+		{
+			return !m_Dialogs.empty();
+		});
+
+		m_ShownDialog = std::move(m_Dialogs.front());
+		m_Dialogs.pop_front();
+
+		// A copy, because the lock is released while the dialog is up.
+		const std::wstring message = m_ShownDialog;
+		guard.unlock();
+		m_MessageBox.load()(Window::NullWindow, message.c_str(), NAME L" - Error", MB_ICONWARNING | MB_OK | MB_SETFOREGROUND);
+		guard.lock();
+
+		m_ShownDialog.clear();
+	}
+}
+
+void Error::SetMessageBox(const message_box_t &message_box)
+{
+	m_MessageBox.store(message_box);
+}
+
+std::wstring_view Error::WidenFunction(const char *const function)
+{
+	{
+		std::shared_lock guard(m_FunctionsLock);
+		if (const auto it = m_Functions.find(function); it != m_Functions.end())
+		{
+			return it->second;
+		}
+	}
+
+	std::wstring functionW = win32::CharToWchar(function);
+	if (functionW.empty())
+	{
+		functionW = L"[failed to convert function name to UTF-16]";
+	}
+
+	std::unique_lock guard(m_FunctionsLock);
+	return m_Functions.try_emplace(function, std::move(functionW)).first->second;
+}
+
+std::wstring &Error::ThreadBuffer()
+{
+	// Keeps its capacity, so that repeated errors don't allocate.
+	thread_local std::wstring buffer;
+	buffer.clear();
+	return buffer;
+}
+
+void Error::AppendInteger(std::wstring &buffer, const int &value)
+{
+	wchar_t digits[12];
+	if (_itow_s(value, digits, 10) == 0)
+	{
+		buffer += digits;
+	}
+}
+
+std::wstring Error::BoxMessage(const Level &level, const wchar_t *const message, const HRESULT &error)
+{
+	std::wstring box = message;
+	box += L"\n\n";
+
+	if (level == Level::Fatal)
+	{
+		box += L"Program will exit.\n\n";
+	}
+
+	box += CachedExceptionFromHRESULT(error);
+	return box;
+}
+
+void Error::ReportSuppressed()
+{
+	std::vector<std::tuple<CALL_SITE, Level, uint32_t>> repeated;
+	{
+		std::lock_guard guard(m_BucketsLock);
+		for (auto &[site, bucket] : m_Buckets)
+		{
+			if (bucket.suppressed != 0)
+			{
+				repeated.emplace_back(site, bucket.level, std::exchange(bucket.suppressed, 0));
+			}
+		}
+	}
+
+	// Outside of the lock, logging can report errors too.
+	for (const auto &[site, level, count] : repeated)
+	{
+		OutputRepeated(site, level, count);
+	}
+}
+
+bool Error::TakeToken(const CALL_SITE &site, const Level &level, uint32_t &repeated)
+{
+	const uint64_t now = GetTickCount64();
+	repeated = 0;
+
+	std::lock_guard guard(m_BucketsLock);
+	const auto [it, inserted] = m_Buckets.try_emplace(site, BUCKET { BURST, now, 0, level });
+	BUCKET &bucket = it->second;
+	if (!inserted)
+	{
+		const uint64_t refill = (now - bucket.last_refill) / REFILL_INTERVAL;
+		if (bucket.tokens + refill >= BURST)
+		{
+			bucket.tokens = BURST;
+			bucket.last_refill = now;
+		}
+		else
+		{
+			bucket.tokens += static_cast<uint32_t>(refill);
+			bucket.last_refill += refill * REFILL_INTERVAL;
+		}
+	}
+
+	if (bucket.tokens == 0)
+	{
+		bucket.suppressed++;
+		return false;
+	}
+
+	bucket.tokens--;
+	repeated = std::exchange(bucket.suppressed, 0);
+	return true;
+}
+
+void Error::OutputRepeated(const CALL_SITE &site, const Level &level, const uint32_t &repeated)
+{
+	if (level == Level::Debug)
+	{
+		std::wstring &message = ThreadBuffer();
+		message += CachedExceptionFromHRESULT(site.error);
+		message += L" from ";
+		message += site.file;
+		message += L':';
+		AppendInteger(message, site.line);
+		message += L" was repeated ";
+		AppendInteger(message, static_cast<int>(repeated));
+		message += L" more times.\n";
+		OutputDebugString(message.c_str());
+	}
+	else
+	{
+		Log::Output(BinaryLog::MessageId::ErrorRepeated, site.error, site.file, site.line, repeated);
+	}
 }
\ No newline at end of file
@@ -1,7 +1,17 @@
 #pragma once
 #include "arch.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
 #include <string>
+#include <string_view>
 #include <tchar.h>
+#include <unordered_map>
 #include <windef.h>
 #include <winerror.h>
 
@@ -10,13 +20,88 @@ class Error {
 public:
 	enum class Level {
 		Fatal,	// Show an error message to the user and immediatly exit
-		Error,	// Show an error message to the user and log
+		Error,	// Show an error message to the user without waiting for it, and log
 		Log,	// Log to file and debug output
 		Debug	// Log to debug output. For use in file log implementation.
 	};
 
 	static bool Handle(const HRESULT &error, const Level &level, const wchar_t *const message, const wchar_t *const file, const int &line, const char *const function);
 	static std::wstring ExceptionFromHRESULT(const HRESULT &result);
+
+	// Same as ExceptionFromHRESULT, but formatted once per code. The view stays valid for the lifetime of the program.
+	static std::wstring_view CachedExceptionFromHRESULT(const HRESULT &result);
+
+	// Reports how many times each held back error was repeated since it was last output.
+	static void ReportSuppressed();
+
+	// Replaces what shows error messages, MessageBox by default. Lets tests run without a desktop to show them on.
+	using message_box_t = int (WINAPI *)(HWND, const wchar_t *, const wchar_t *, UINT);
+	static void SetMessageBox(const message_box_t &message_box);
+
+private:
+	// Logged and debug errors repeating from the same place with the same code get a burst,
+	// then are let through at a slow rate. The ones held back are only counted.
+	static constexpr uint32_t BURST = 10;
+	static constexpr uint64_t REFILL_INTERVAL = 60000; // Milliseconds per token
+
+	struct CALL_SITE {
+		const wchar_t *file; // Always a literal
+		int line;
+		HRESULT error;
+
+		inline bool operator ==(const CALL_SITE &other) const
+		{
+			return file == other.file && line == other.line && error == other.error;
+		}
+	};
+
+	struct CALL_SITE_HASH {
+		inline std::size_t operator()(const CALL_SITE &site) const noexcept
+		{
+			return std::hash<const wchar_t *>()(site.file) ^ (static_cast<std::size_t>(site.line) << 16) ^ static_cast<std::size_t>(site.error);
+		}
+	};
+
+	struct BUCKET {
+		uint32_t tokens;
+		uint64_t last_refill;
+		uint32_t suppressed;
+		Level level;
+	};
+
+	static std::mutex m_BucketsLock;
+	static std::unordered_map<CALL_SITE, BUCKET, CALL_SITE_HASH> m_Buckets;
+
+	// Past this, messages are formatted every time instead of filling the cache with one off codes.
+	static constexpr std::size_t MAX_CACHED_MESSAGES = 64;
+
+	static std::shared_mutex m_MessagesLock;
+	static std::unordered_map<HRESULT, std::wstring> m_Messages;
+
+	// Function names are literals, so they are keyed by address and only converted the first time.
+	// clang-cl has no wide __FUNCSIG__ to do it at compile time.
+	static std::shared_mutex m_FunctionsLock;
+	static std::unordered_map<const char *, std::wstring> m_Functions;
+
+	// Error messages are shown one at a time by a thread of their own, so that raising one never blocks.
+	// A message that is already waiting or on screen isn't queued again.
+	static std::once_flag m_DialogThreadFlag;
+	static std::mutex m_DialogsLock;
+	static std::condition_variable m_DialogsAvailable;
+	static std::deque<std::wstring> m_Dialogs;
+	static std::wstring m_ShownDialog;
+	static std::atomic<message_box_t> m_MessageBox;
+
+	static void QueueDialog(std::wstring message);
+	static void DialogThread();
+
+	static std::wstring_view WidenFunction(const char *const function);
+	static std::wstring &ThreadBuffer();
+	static void AppendInteger(std::wstring &buffer, const int &value);
+	static std::wstring BoxMessage(const Level &level, const wchar_t *const message, const HRESULT &error);
+
+	static bool TakeToken(const CALL_SITE &site, const Level &level, uint32_t &repeated);
+	static void OutputRepeated(const CALL_SITE &site, const Level &level, const uint32_t &repeated);
 };
 
 #define ErrorHandle(x, y, z) (Error::Handle((x), (y), (z), _T(__FILE__), __LINE__, __FUNCSIG__))
@@ -1,57 +1,94 @@
 #include "ttblog.hpp"
+#include <algorithm>
 #include <ctime>
-#include <cwchar>
 #include <fileapi.h>
-#include <fstream>
 #include <PathCch.h>
 #include <processthreadsapi.h>
-#include <sstream>
+#include <synchapi.h>
+#include <sysinfoapi.h>
 #include <thread>
-#ifndef STORE
 #include <vector>
-#endif
 #include <WinBase.h>
 #include <winerror.h>
+#include <winioctl.h>
 #include <winnt.h>
 #include <WinUser.h>
 
 #include "autofree.hpp"
 #include "common.hpp"
+#include "config.hpp"
+#include "util.hpp"
 #include "win32.hpp"
 #include "window.hpp"
 #ifdef STORE
 #include "uwp.hpp"
 #endif
 
-std::mutex Log::m_LogLock;
+std::atomic<bool> Log::m_Verbose =
+#ifndef _DEBUG
+	false;
+#else
+	true;
+#endif
+
+std::once_flag Log::m_InitFlag;
+std::atomic<bool> Log::m_InitDone;
 std::optional<winrt::file_handle> Log::m_FileHandle;
+std::mutex Log::m_FileLock;
 std::wstring Log::m_File;
+bool Log::m_Binary;
+BinaryLog::FILE_HEADER Log::m_Header;
+
+std::wstring Log::m_Folder;
+std::wstring Log::m_FolderOverride;
+std::wstring Log::m_BaseName;
+uint32_t Log::m_SegmentIndex;
+uint64_t Log::m_SegmentSize;
+uint64_t Log::m_SegmentStart;
+std::mutex Log::m_MaintenanceLock;
+
+Log::RECORD *Log::m_Queue;
+std::atomic<uint32_t> Log::m_EnqueuePos;
+uint32_t Log::m_DequeuePos;
+std::atomic<uint32_t> Log::m_Dropped;
+
+winrt::handle Log::m_WakeEvent;
+std::atomic<bool> Log::m_WriterSleeping;
+
+std::mutex Log::m_FlushLock;
+std::condition_variable Log::m_Flushed;
+std::atomic<uint32_t> Log::m_WrittenPos;
+std::atomic<uint32_t> Log::m_FlushRequests;
+std::atomic<uint32_t> Log::m_FlushesDone;
 
 std::pair<HRESULT, std::wstring> Log::InitStream()
 {
-	HRESULT hr;
 	m_FileHandle.emplace(); // put this here so that if we fail before creating the file, we won't try constantly doing init.
 #ifndef STORE
-	std::wstring temp;
-	temp.resize(LONG_PATH);
-	int size = GetTempPath(LONG_PATH, temp.data());
-	if (!size)
-	{
-		return { HRESULT_FROM_WIN32(GetLastError()), L"Failed to determine temporary folder location!" };
-	}
-	temp.resize(size);
-
 	AutoFree::DebugLocal<wchar_t> log_folder_safe;
-	hr = PathAllocCombine(temp.c_str(), NAME, PATHCCH_ALLOW_LONG_PATHS, log_folder_safe.put());
-	if (FAILED(hr))
+	const wchar_t *log_folder = m_FolderOverride.c_str();
+	if (m_FolderOverride.empty())
 	{
-		return { hr, L"Failed to combine temporary folder location and app name!" };
+		std::wstring temp;
+		temp.resize(LONG_PATH);
+		int size = GetTempPath(LONG_PATH, temp.data());
+		if (!size)
+		{
+			return { HRESULT_FROM_WIN32(GetLastError()), L"Failed to determine temporary folder location!" };
+		}
+		temp.resize(size);
+
+		const HRESULT hr = PathAllocCombine(temp.c_str(), NAME, PATHCCH_ALLOW_LONG_PATHS, log_folder_safe.put());
+		if (FAILED(hr))
+		{
+			return { hr, L"Failed to combine temporary folder location and app name!" };
+		}
+		log_folder = log_folder_safe.get();
 	}
-	const wchar_t *log_folder = log_folder_safe.get();
 #else
 	try
 	{
-		winrt::hstring tempFolder_str = UWP::GetApplicationFolderPath(UWP::FolderType::Temporary);
+		winrt::hstring tempFolder_str = m_FolderOverride.empty() ? UWP::GetApplicationFolderPath(UWP::FolderType::Temporary) : winrt::hstring(m_FolderOverride);
 		const wchar_t *log_folder = tempFolder_str.c_str();
 #endif
 
@@ -63,7 +100,8 @@ std::pair<HRESULT, std::wstring> Log::InitStream()
 		}
 	}
 
-	std::wstring log_filename;
+	m_Folder = log_folder;
+
 	FILETIME creationTime;
 	FILETIME useless1;
 	FILETIME useless2;
@@ -87,35 +125,33 @@ std::pair<HRESULT, std::wstring> Log::InitStream()
 		// Remove the difference.
 		creationTimestamp.QuadPart -= 11644473600;
 
-		log_filename = std::to_wstring(creationTimestamp.QuadPart) + L".log";
+		m_BaseName = std::to_wstring(creationTimestamp.QuadPart);
 	}
 	else
 	{
 		// Fallback to current time
 		std::time_t unix_epoch = std::time(0);
-		log_filename = std::to_wstring(unix_epoch) + L".log";
+		m_BaseName = std::to_wstring(unix_epoch);
 	}
 
-	AutoFree::DebugLocal<wchar_t> log_file;
-	hr = PathAllocCombine(log_folder, log_filename.c_str(), PATHCCH_ALLOW_LONG_PATHS, log_file.put());
-	if (FAILED(hr))
-	{
-		return { hr, L"Failed to combine log folder location and log file name!" };
-	}
+	// Both formats use this to turn performance counter values into times.
+	FILETIME startTime;
+	LARGE_INTEGER startTicks, frequency;
+	GetSystemTimePreciseAsFileTime(&startTime);
+	QueryPerformanceCounter(&startTicks);
+	QueryPerformanceFrequency(&frequency);
 
-	m_FileHandle = CreateFile(log_file.get(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
-	if (!*m_FileHandle)
-	{
-		return { HRESULT_FROM_WIN32(GetLastError()), L"Failed to create and open log file!" };
-	}
+	m_Header.magic = BinaryLog::MAGIC;
+	m_Header.version = BinaryLog::VERSION;
+	m_Header.start_time = (static_cast<uint64_t>(startTime.dwHighDateTime) << 32) | startTime.dwLowDateTime;
+	m_Header.start_ticks = static_cast<uint64_t>(startTicks.QuadPart);
+	m_Header.frequency = static_cast<uint64_t>(frequency.QuadPart);
 
-	DWORD bytesWritten;
-	if (!WriteFile(m_FileHandle->get(), L"\uFEFF", sizeof(wchar_t), &bytesWritten, NULL))
+	if (!OpenSegment())
 	{
-		LastErrorHandle(Error::Level::Debug, L"Failed to write byte-order marker.");
+		return { HRESULT_FROM_WIN32(GetLastError()), L"Failed to create and open log file!" };
 	}
 
-	m_File = log_file.get();
 	return { S_OK, L"" };
 
 #ifdef STORE
@@ -127,56 +163,442 @@ std::pair<HRESULT, std::wstring> Log::InitStream()
 #endif
 }
 
-void Log::OutputMessage(const std::wstring &message)
+bool Log::OpenSegment()
 {
-	std::lock_guard guard(m_LogLock);
+	// Messages logged while parsing the configuration come before it is published, so the format is picked
+	// for every file instead of once. NeedsRotation starts a new file when the setting changes.
+	const bool binary = Config::Current()->BINARY_LOG;
 
-	if (!init_done())
+	// The first file of a session keeps the plain name, the next ones are numbered.
+	std::wstring path = m_Folder + L'\\' + m_BaseName;
+	if (m_SegmentIndex != 0)
 	{
-		auto [hr, err_message] = InitStream();
-		if (FAILED(hr))
+		path += L'-' + std::to_wstring(m_SegmentIndex);
+	}
+	path += binary ? L".binlog" : L".log";
+
+	winrt::file_handle handle(CreateFile(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+	if (!handle)
+	{
+		return false;
+	}
+
+	DWORD bytesWritten = 0;
+	if (binary)
+	{
+		if (!WriteFile(handle.get(), &m_Header, sizeof(m_Header), &bytesWritten, NULL))
+		{
+			LastErrorHandle(Error::Level::Debug, L"Failed to write log file header.");
+		}
+	}
+	else if (!WriteFile(handle.get(), L"\uFEFF", sizeof(wchar_t), &bytesWritten, NULL))
+	{
+		LastErrorHandle(Error::Level::Debug, L"Failed to write byte-order marker.");
+	}
+
+	*m_FileHandle = std::move(handle);
+	m_Binary = binary;
+	{
+		std::lock_guard guard(m_FileLock);
+		m_File = std::move(path);
+	}
+
+	m_SegmentIndex++;
+	m_SegmentSize = bytesWritten;
+	m_SegmentStart = GetTickCount64();
+	return true;
+}
+
+bool Log::NeedsRotation()
+{
+	const auto config = Config::Current();
+	if (config->BINARY_LOG != m_Binary)
+	{
+		return true;
+	}
+
+	const uint64_t budget = config->LOG_BUDGET * 1024ull * 1024ull;
+	return m_SegmentSize >= std::max(budget / SEGMENTS_PER_BUDGET, MIN_SEGMENT_SIZE) || GetTickCount64() - m_SegmentStart >= MAX_SEGMENT_AGE;
+}
+
+void Log::Maintain()
+{
+	// Nothing here is urgent, so stay out of the way of the program and the user.
+	SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+	std::lock_guard maintenanceGuard(m_MaintenanceLock);
+
+	std::wstring active;
+	{
+		std::lock_guard guard(m_FileLock);
+		active = m_File;
+	}
+
+	struct LOG_FILE {
+		std::wstring path;
+		uint64_t write_time;
+		bool compressed;
+	};
+
+	std::vector<LOG_FILE> files;
+	WIN32_FIND_DATA data;
+	const HANDLE find = FindFirstFile((m_Folder + L"\\*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE)
+	{
+		LastErrorHandle(Error::Level::Log, L"Failed to enumerate log files.");
+		return;
+	}
+
+	do
+	{
+		// Text copies of binary logs end in .binlog.txt, and saved diagnostics count towards the budget too.
+		const std::wstring_view name = data.cFileName;
+		const bool is_log = Util::StringEndsWith(name, L".log") || Util::StringEndsWith(name, L".binlog") ||
+			Util::StringEndsWith(name, L".txt") || Util::StringEndsWith(name, L".json");
+		std::wstring path = m_Folder + L'\\' + data.cFileName;
+		if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_log && path != active)
 		{
-			// https://stackoverflow.com/questions/50799719/reference-to-local-binding-declared-in-enclosing-function
-			std::thread([hr = hr, err_message = err_message]() mutable
+			files.push_back({
+				std::move(path),
+				(static_cast<uint64_t>(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime,
+				(data.dwFileAttributes & FILE_ATTRIBUTE_COMPRESSED) != 0
+			});
+		}
+	}
+	while (FindNextFile(find, &data));
+	FindClose(find);
+
+	std::sort(files.begin(), files.end(), [](const LOG_FILE &a, const LOG_FILE &b)
+	{
+		return a.write_time > b.write_time;
+	});
+
+	FILETIME now_filetime;
+	GetSystemTimeAsFileTime(&now_filetime);
+	const uint64_t now = (static_cast<uint64_t>(now_filetime.dwHighDateTime) << 32) | now_filetime.dwLowDateTime;
+
+	// The active file can grow up to a segment, keep room for it.
+	const uint64_t budget = Config::Current()->LOG_BUDGET * 1024ull * 1024ull;
+	uint64_t used = std::max(budget / SEGMENTS_PER_BUDGET, MIN_SEGMENT_SIZE);
+
+	// Newest first, so that when over budget the oldest logs go.
+	for (const LOG_FILE &log : files)
+	{
+		bool keep = now - log.write_time < MAX_LOG_AGE;
+		if (keep)
+		{
+			if (!log.compressed && !Compress(log.path))
+			{
+				LastErrorHandle(Error::Level::Debug, L"Failed to compress log file.");
+			}
+
+			DWORD high;
+			const DWORD low = GetCompressedFileSize(log.path.c_str(), &high);
+			if (low != INVALID_FILE_SIZE || GetLastError() == NO_ERROR)
 			{
-				std::wstring boxbuffer = err_message +
-				L" Logs will not be available during this session.\n\n" + Error::ExceptionFromHRESULT(hr);
+				used += (static_cast<uint64_t>(high) << 32) | low;
+			}
 
-				err_message += L'\n';
-				OutputDebugString(err_message.c_str()); // OutputDebugString is thread-safe, no issues using it here.
+			keep = used <= budget;
+		}
 
-				MessageBox(Window::NullWindow, boxbuffer.c_str(), NAME L" - Error", MB_ICONWARNING | MB_OK | MB_SETFOREGROUND);
-			}).detach();
+		// Fails when the file is open elsewhere, for example a text copy in an editor. It will be retried next time.
+		if (!keep && !DeleteFile(log.path.c_str()))
+		{
+			LastErrorHandle(Error::Level::Debug, L"Failed to delete old log file.");
 		}
 	}
+}
+
+bool Log::Compress(const std::wstring &file)
+{
+	// NTFS compression, so that the files stay readable by anything.
+	const winrt::file_handle handle(CreateFile(file.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL));
+	if (!handle)
+	{
+		return false;
+	}
 
-	OutputDebugString((message + L'\n').c_str());
+	USHORT format = COMPRESSION_FORMAT_DEFAULT;
+	DWORD bytesReturned;
+	return DeviceIoControl(handle.get(), FSCTL_SET_COMPRESSION, &format, sizeof(format), NULL, 0, &bytesReturned, NULL);
+}
 
-	if (*m_FileHandle)
+void Log::Init()
+{
+	auto [hr, err_message] = InitStream();
+	if (FAILED(hr))
 	{
-		std::time_t current_time = std::time(0);
+		// https://stackoverflow.com/questions/50799719/reference-to-local-binding-declared-in-enclosing-function
+		std::thread([hr = hr, err_message = err_message]() mutable
+		{
+			std::wstring boxbuffer = err_message +
+			L" Logs will not be available during this session.\n\n" + Error::ExceptionFromHRESULT(hr);
 
-		std::wostringstream buffer;
-		buffer << L'(' << _wctime(&current_time);
-		buffer.seekp(-1, std::ios_base::end); // Seek behind the newline created by _wctime
-		buffer << L") " << message << L"\r\n";
+			err_message += L'\n';
+			OutputDebugString(err_message.c_str()); // OutputDebugString is thread-safe, no issues using it here.
 
-		const std::wstring error = buffer.str();
+			MessageBox(Window::NullWindow, boxbuffer.c_str(), NAME L" - Error", MB_ICONWARNING | MB_OK | MB_SETFOREGROUND);
+		}).detach();
+	}
+	else
+	{
+		m_WakeEvent.attach(CreateEvent(NULL, FALSE, FALSE, NULL));
+		if (m_WakeEvent)
+		{
+			// Never freed, the writer thread uses it until the process dies.
+			m_Queue = new RECORD[QUEUE_SIZE];
+			for (uint32_t i = 0; i < QUEUE_SIZE; i++)
+			{
+				m_Queue[i].sequence.store(i, std::memory_order_relaxed);
+			}
 
-		DWORD bytesWritten;
-		if (!WriteFile(m_FileHandle->get(), error.c_str(), error.length() * sizeof(wchar_t), &bytesWritten, NULL))
+			std::thread(WriterThread).detach();
+			std::thread(Maintain).detach();
+		}
+		else
 		{
-			LastErrorHandle(Error::Level::Debug, L"Writing to log file failed.");
+			LastErrorHandle(Error::Level::Debug, L"Failed to create log writer event.");
+			m_FileHandle->close();
+
+			std::lock_guard guard(m_FileLock);
+			m_File.clear();
 		}
 	}
+
+	m_InitDone.store(true, std::memory_order_release);
+}
+
+Log::RECORD *Log::Claim(uint32_t &pos)
+{
+	pos = m_EnqueuePos.load(std::memory_order_relaxed);
+	while (true)
+	{
+		RECORD *const record = &m_Queue[pos & (QUEUE_SIZE - 1)];
+		const int32_t difference = static_cast<int32_t>(record->sequence.load(std::memory_order_acquire) - pos);
+		if (difference == 0)
+		{
+			if (m_EnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				return record;
+			}
+		}
+		else if (difference < 0)
+		{
+			// The writer didn't get to this slot yet, the queue is full.
+			return nullptr;
+		}
+		else
+		{
+			// Another producer claimed this slot.
+			pos = m_EnqueuePos.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+void Log::Publish(RECORD &record, const uint32_t &pos)
+{
+	// Once published the writer owns the record, so this has to come first.
+	if (IsDebuggerPresent())
+	{
+		OutputToDebugger(record.entry);
+	}
+
+	record.sequence.store(pos + 1, std::memory_order_release);
+	WakeWriter();
+}
+
+bool Log::IsQueueEmpty()
+{
+	const RECORD &record = m_Queue[m_DequeuePos & (QUEUE_SIZE - 1)];
+	return static_cast<int32_t>(record.sequence.load(std::memory_order_acquire) - (m_DequeuePos + 1)) < 0;
+}
+
+void Log::WakeWriter()
+{
+	// Pairs with the fence in WriterThread: either the writer sees our record, or we see that it's going to sleep.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_WriterSleeping.load(std::memory_order_relaxed) && m_WriterSleeping.exchange(false, std::memory_order_relaxed))
+	{
+		SetEvent(m_WakeEvent.get());
+	}
+}
+
+void Log::WriterThread()
+{
+	BinaryLog::Formatter formatter(m_Header, DescribeHResult);
+	BinaryLog::Encoder encoder(m_Header.start_ticks);
+	std::wstring text;
+	std::vector<uint8_t> binary;
+	const auto append = [&formatter, &encoder, &text, &binary](const BinaryLog::ENTRY &entry)
+	{
+		if (m_Binary)
+		{
+			encoder.Encode(entry, binary);
+		}
+		else
+		{
+			formatter.Format(entry, text);
+		}
+	};
+
+	uint32_t flushes_done = 0;
+	while (true)
+	{
+		const uint32_t flush_requests = m_FlushRequests.load(std::memory_order_acquire);
+
+		// Between batches, so that a file never ends with a partial batch and string definitions stay in the file using them.
+		if (!IsQueueEmpty() && NeedsRotation())
+		{
+			if (OpenSegment())
+			{
+				encoder = BinaryLog::Encoder(m_Header.start_ticks);
+				std::thread(Maintain).detach();
+			}
+			else
+			{
+				LastErrorHandle(Error::Level::Debug, L"Failed to open new log file.");
+
+				// Keep appending to the current file, and try again after another segment worth of messages.
+				m_SegmentSize = 0;
+				m_SegmentStart = GetTickCount64();
+			}
+		}
+
+		text.clear();
+		binary.clear();
+		while (!IsQueueEmpty())
+		{
+			RECORD &record = m_Queue[m_DequeuePos & (QUEUE_SIZE - 1)];
+			append(record.entry);
+
+			record.sequence.store(m_DequeuePos + QUEUE_SIZE, std::memory_order_release);
+			m_DequeuePos++;
+		}
+
+		if (const uint32_t dropped = m_Dropped.exchange(0, std::memory_order_relaxed); dropped != 0)
+		{
+			BinaryLog::ENTRY entry;
+			Fill(entry, BinaryLog::MessageId::MessagesDropped, dropped);
+			append(entry);
+		}
+
+		const void *const data = m_Binary ? static_cast<const void *>(binary.data()) : text.data();
+		const size_t size = m_Binary ? binary.size() : text.length() * sizeof(wchar_t);
+		if (size != 0)
+		{
+			DWORD bytesWritten;
+			if (!WriteFile(m_FileHandle->get(), data, static_cast<DWORD>(size), &bytesWritten, NULL))
+			{
+				LastErrorHandle(Error::Level::Debug, L"Writing to log file failed.");
+			}
+
+			m_SegmentSize += size;
+		}
+
+		if (flush_requests != flushes_done)
+		{
+			if (!FlushFileBuffers(m_FileHandle->get()))
+			{
+				LastErrorHandle(Error::Level::Debug, L"Flusing log file buffer failed.");
+			}
+			flushes_done = flush_requests;
+		}
+
+		{
+			std::lock_guard guard(m_FlushLock);
+			m_WrittenPos.store(m_DequeuePos, std::memory_order_release);
+			m_FlushesDone.store(flushes_done, std::memory_order_release);
+		}
+		m_Flushed.notify_all();
+
+		m_WriterSleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (IsQueueEmpty())
+		{
+			WaitForSingleObject(m_WakeEvent.get(), INFINITE);
+		}
+		m_WriterSleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+std::wstring Log::DescribeHResult(const int32_t &hr)
+{
+	return std::wstring(Error::CachedExceptionFromHRESULT(hr));
+}
+
+void Log::OutputToDebugger(const BinaryLog::ENTRY &entry)
+{
+	std::wstring message;
+	BinaryLog::AppendText(entry, message, DescribeHResult);
+	message += L'\n';
+	OutputDebugString(message.c_str());
+}
+
+std::wstring Log::ViewableFile()
+{
+	Flush();
+	const std::wstring log_file = file();
+	if (!m_Binary || log_file.empty())
+	{
+		return log_file;
+	}
+
+	// The writer still has the file open for writing, so share that.
+	std::vector<uint8_t> data;
+	{
+		const winrt::file_handle source(CreateFile(log_file.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL));
+		LARGE_INTEGER size;
+		if (!source || !GetFileSizeEx(source.get(), &size))
+		{
+			LastErrorHandle(Error::Level::Log, L"Failed to open log file for reading.");
+			return log_file;
+		}
+
+		data.resize(static_cast<size_t>(size.QuadPart));
+		DWORD bytesRead;
+		if (!ReadFile(source.get(), data.data(), static_cast<DWORD>(data.size()), &bytesRead, NULL))
+		{
+			LastErrorHandle(Error::Level::Log, L"Failed to read log file.");
+			return log_file;
+		}
+		data.resize(bytesRead);
+	}
+
+	std::wstring text = L"\uFEFF";
+	if (!BinaryLog::Decode(data.data(), data.size(), text, DescribeHResult))
+	{
+		OutputMessage(L"Binary log is corrupted, its text copy stops where the corruption starts.");
+	}
+
+	const std::wstring text_file = log_file + L".txt";
+	if (!win32::WriteFileAtomically(text_file, text.data(), text.length() * sizeof(wchar_t)))
+	{
+		LastErrorHandle(Error::Level::Log, L"Failed to write text copy of log file.");
+		return log_file;
+	}
+
+	return text_file;
 }
 
 void Log::Flush()
 {
-	std::lock_guard guard(m_LogLock);
+	// Whoever reads the log next should know about errors that were held back.
+	Error::ReportSuppressed();
 
-	if (!FlushFileBuffers(m_FileHandle->get()))
+	if (!init_done() || !m_Queue)
 	{
-		LastErrorHandle(Error::Level::Debug, L"Flusing log file buffer failed.");
+		return;
 	}
+
+	// The writer does the flushing, it is the only one touching the file, which changes on rotation.
+	const uint32_t target = m_EnqueuePos.load(std::memory_order_acquire);
+	const uint32_t request = m_FlushRequests.fetch_add(1, std::memory_order_acq_rel) + 1;
+	SetEvent(m_WakeEvent.get());
+
+	std::unique_lock guard(m_FlushLock);
+	m_Flushed.wait(guard, [target, request]
+	{
+		return static_cast<int32_t>(m_WrittenPos.load(std::memory_order_acquire) - target) >= 0 &&
+			static_cast<int32_t>(m_FlushesDone.load(std::memory_order_acquire) - request) >= 0;
+	});
 }
\ No newline at end of file
@@ -1,30 +1,229 @@
 #pragma once
 #include "arch.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <debugapi.h>
 #include <mutex>
+#include <profileapi.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <optional>
 #include <windef.h>
 #include <winrt/base.h>
 
+#include "binarylog.hpp"
+
+// Messages are queued by the calling thread and written to the file by a background thread.
+// They are formatted by the writer, either to text or to the compact format of BinaryLog.
 class Log {
 
+public:
+	enum class Level {
+		Debug,		// Compiled out of release builds
+		Verbose,	// Only when verbose logging is on
+		Info		// Always
+	};
+
 private:
-	static std::mutex m_LogLock;
-	static std::optional<winrt::file_handle> m_FileHandle;
+	// A slot of the message queue. The sequence tells who owns the slot, producers or the writer.
+	struct RECORD {
+		std::atomic<uint32_t> sequence;
+		BinaryLog::ENTRY entry;
+	};
+
+	// Must be a power of two. When full, new messages are dropped and counted.
+	static constexpr uint32_t QUEUE_SIZE = 1024;
+
+	// The active file is closed once it reaches its share of the budget, or is a day old.
+	static constexpr uint64_t SEGMENTS_PER_BUDGET = 4;
+	static constexpr uint64_t MIN_SEGMENT_SIZE = 256 * 1024;
+	static constexpr uint64_t MAX_SEGMENT_AGE = 24 * 60 * 60 * 1000;			// Milliseconds
+	static constexpr uint64_t MAX_LOG_AGE = 7ull * 24 * 60 * 60 * 10000000;	// Hundreds of nanoseconds
+
+	static std::atomic<bool> m_Verbose;
+
+	static std::once_flag m_InitFlag;
+	static std::atomic<bool> m_InitDone;
+	static std::optional<winrt::file_handle> m_FileHandle;	// Only touched by the writer once initialized
+	static std::mutex m_FileLock;
 	static std::wstring m_File;
+	static bool m_Binary;
+	static BinaryLog::FILE_HEADER m_Header;
+
+	// Rotation state, owned by the writer.
+	static std::wstring m_Folder;
+	static std::wstring m_FolderOverride;
+	static std::wstring m_BaseName;
+	static uint32_t m_SegmentIndex;
+	static uint64_t m_SegmentSize;
+	static uint64_t m_SegmentStart;
+	static std::mutex m_MaintenanceLock;
+
+	static RECORD *m_Queue;
+	static std::atomic<uint32_t> m_EnqueuePos;
+	static uint32_t m_DequeuePos;
+	static std::atomic<uint32_t> m_Dropped;
+
+	static winrt::handle m_WakeEvent;
+	static std::atomic<bool> m_WriterSleeping;
+
+	static std::mutex m_FlushLock;
+	static std::condition_variable m_Flushed;
+	static std::atomic<uint32_t> m_WrittenPos;
+	static std::atomic<uint32_t> m_FlushRequests;
+	static std::atomic<uint32_t> m_FlushesDone;
 
 	static std::pair<HRESULT, std::wstring> InitStream();
+	static void Init();
+	static bool OpenSegment();
+	static bool NeedsRotation();
+	static void Maintain();
+	static bool Compress(const std::wstring &file);
+	static RECORD *Claim(uint32_t &pos);
+	static void Publish(RECORD &record, const uint32_t &pos);
+	static bool IsQueueEmpty();
+	static void WakeWriter();
+	static void WriterThread();
+	static std::wstring DescribeHResult(const int32_t &hr);
+	static void OutputToDebugger(const BinaryLog::ENTRY &entry);
+
+	inline static void StoreArgument(BinaryLog::ENTRY &entry, const size_t &i, std::wstring_view value)
+	{
+		entry.values[i] = value.length();
+		entry.text.append(value);
+	}
+
+	inline static void StoreArgument(BinaryLog::ENTRY &entry, const size_t &i, HWND value)
+	{
+		entry.values[i] = reinterpret_cast<uintptr_t>(value);
+	}
+
+	template<typename T>
+	inline static std::enable_if_t<std::is_integral_v<T>> StoreArgument(BinaryLog::ENTRY &entry, const size_t &i, const T &value)
+	{
+		entry.values[i] = static_cast<uint64_t>(static_cast<int64_t>(value));
+	}
+
+	template<typename... Args>
+	inline static void Fill(BinaryLog::ENTRY &entry, const BinaryLog::MessageId &id, const Args &...args)
+	{
+		LARGE_INTEGER ticks;
+		QueryPerformanceCounter(&ticks);
+
+		entry.id = id;
+		entry.ticks = static_cast<uint64_t>(ticks.QuadPart);
+		entry.text.clear();
+
+		[[maybe_unused]] size_t i = 0;
+		(StoreArgument(entry, i++, args), ...);
+	}
 
 public:
+	// Call through LogMessage, which skips evaluating the arguments when this is false.
+	inline static bool enabled(const Level &level)
+	{
+		return level == Level::Info || m_Verbose.load(std::memory_order_relaxed);
+	}
+
+	// Mirrors the VERBOSE setting of the published configuration.
+	inline static void set_verbose(const bool &verbose)
+	{
+		m_Verbose.store(verbose, std::memory_order_relaxed);
+	}
+
 	inline static bool init_done()
 	{
-		return m_FileHandle.has_value();
+		return m_InitDone.load(std::memory_order_acquire);
 	}
-	inline static const std::wstring &file()
+	inline static std::wstring file()
 	{
+		if (!init_done())
+		{
+			return { };
+		}
+
+		std::lock_guard guard(m_FileLock);
 		return m_File;
 	}
-	static void OutputMessage(const std::wstring &message);
+
+	// Where the log files are, initializing the log if needed. Empty if that failed.
+	inline static const std::wstring &folder()
+	{
+		std::call_once(m_InitFlag, Init);
+		return m_Folder;
+	}
+
+	// Puts the logs in this folder instead of the temporary folder, so that tests leave the user's logs alone.
+	// Only has an effect when called before anything is logged.
+	inline static void SetFolder(std::wstring folder)
+	{
+		m_FolderOverride = std::move(folder);
+	}
+
+	// Never blocks on file I/O, and never fails. Messages that don't fit in the queue are dropped.
+	// The arguments are strings, window handles or integers, in the order of the message's format.
+	template<typename... Args>
+	inline static void Output(const BinaryLog::MessageId &id, const Args &...args)
+	{
+		static_assert(sizeof...(Args) <= BinaryLog::MAX_ARGUMENTS, "Too many arguments for a log message.");
+		std::call_once(m_InitFlag, Init);
+
+		uint32_t pos;
+		if (RECORD *const record = m_Queue ? Claim(pos) : nullptr)
+		{
+			// Filled in place, so the slot's string keeps its capacity from one message to the next.
+			Fill(record->entry, id, args...);
+			Publish(*record, pos);
+		}
+		else
+		{
+			if (m_Queue)
+			{
+				m_Dropped.fetch_add(1, std::memory_order_relaxed);
+			}
+
+			// Nobody reads it without a debugger, don't pay for it.
+			if (IsDebuggerPresent())
+			{
+				BinaryLog::ENTRY entry;
+				Fill(entry, id, args...);
+				OutputToDebugger(entry);
+			}
+		}
+	}
+
+	inline static void OutputMessage(std::wstring_view message)
+	{
+		Output(BinaryLog::MessageId::Text, message);
+	}
+
+	// Flushes the log and returns a file that can be opened in a text editor.
+	// For binary logs, this is a text copy of the log made next to it.
+	static std::wstring ViewableFile();
+
+	// Waits until every message queued so far is written to disk.
 	static void Flush();
-};
\ No newline at end of file
+};
+
+// Log statements under this level are compiled out.
+#ifdef _DEBUG
+#define LOG_MIN_LEVEL Log::Level::Debug
+#else
+#define LOG_MIN_LEVEL Log::Level::Verbose
+#endif
+
+// Outputs a message of the table in BinaryLog, formatted later by the log writer.
+// When the level is disabled, the arguments aren't evaluated and the statement costs a single branch.
+#define LogMessage(level, ...) do \
+{ \
+	if constexpr ((level) >= LOG_MIN_LEVEL) \
+	{ \
+		if (Log::enabled(level)) \
+		{ \
+			Log::Output(__VA_ARGS__); \
+		} \
+	} \
+} while (false)
\ No newline at end of file
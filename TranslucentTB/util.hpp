@@ -1,19 +1,84 @@
 #pragma once
 #include <algorithm>
+#include <charconv>
 #include <cstdint>
 #include <cwctype>
+#include <functional>
+#include <iterator>
 #include <limits>
 #include <random>
 #include <string>
+#include <string_view>
+#include <system_error>
 #include <unordered_map>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define UTIL_SSE2
+#include <emmintrin.h>
+#endif
+
 class Util {
 
+private:
+#ifdef UTIL_SSE2
+	// Number of UTF-16 code units processed at once by the vectorized loops.
+	static constexpr size_t BLOCK_SIZE = sizeof(__m128i) / sizeof(wchar_t);
+
+	// Checks that a block only contains ASCII characters.
+	inline static bool IsAsciiBlock(const __m128i &block)
+	{
+		return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(block, _mm_set1_epi16(-0x80)), _mm_setzero_si128())) == 0xFFFF;
+	}
+
+	// Lowercases a block only made of ASCII characters.
+	inline static __m128i ToLowerAsciiBlock(const __m128i &block)
+	{
+		// Everything is ASCII, so the signed comparisons are fine.
+		const __m128i is_upper = _mm_and_si128(_mm_cmpgt_epi16(block, _mm_set1_epi16(L'A' - 1)), _mm_cmplt_epi16(block, _mm_set1_epi16(L'Z' + 1)));
+		return _mm_add_epi16(block, _mm_and_si128(is_upper, _mm_set1_epi16(L'a' - L'A')));
+	}
+#endif
+
 public:
+	// Converts a character to its lowercase variant. Same result as std::towlower, but skips the CRT for ASCII.
+	inline static wchar_t ToLower(const wchar_t &character)
+	{
+		if (character < 0x80)
+		{
+			return character >= L'A' && character <= L'Z' ? character + (L'a' - L'A') : character;
+		}
+		else
+		{
+			return static_cast<wchar_t>(std::towlower(character));
+		}
+	}
+
+	// Converts a string to its lowercase variant
+	inline static void ToLowerInplace(wchar_t *data, const size_t &length)
+	{
+		size_t i = 0;
+#ifdef UTIL_SSE2
+		for (; i + BLOCK_SIZE <= length; i += BLOCK_SIZE)
+		{
+			__m128i *address = reinterpret_cast<__m128i *>(data + i);
+			const __m128i block = _mm_loadu_si128(address);
+			if (IsAsciiBlock(block))
+			{
+				_mm_storeu_si128(address, ToLowerAsciiBlock(block));
+			}
+			else
+			{
+				std::transform(data + i, data + i + BLOCK_SIZE, data + i, [](const wchar_t &c) { return ToLower(c); });
+			}
+		}
+#endif
+		std::transform(data + i, data + length, data + i, [](const wchar_t &c) { return ToLower(c); });
+	}
+
 	// Converts a string to its lowercase variant
 	inline static void ToLowerInplace(std::wstring &data)
 	{
-		std::transform(data.begin(), data.end(), data.begin(), std::towlower);
+		ToLowerInplace(data.data(), data.length());
 	}
 
 	// Converts a string to its lowercase variant
@@ -26,26 +91,105 @@ public:
 	template<size_t s>
 	inline static bool IgnoreCaseStringEquals(const std::wstring &l, const wchar_t (&r)[s])
 	{
-		return std::equal(l.begin(), l.end(), r, r + s - 1, [](const wchar_t &a, const wchar_t &b) -> bool
+		return IgnoreCaseStringEquals(std::wstring_view(l), std::wstring_view(r, s - 1));
+	}
+
+	inline static bool IgnoreCaseStringEquals(std::wstring_view l, std::wstring_view r)
+	{
+		if (l.length() != r.length())
+		{
+			return false;
+		}
+
+		size_t i = 0;
+#ifdef UTIL_SSE2
+		for (; i + BLOCK_SIZE <= l.length(); i += BLOCK_SIZE)
+		{
+			const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i *>(l.data() + i));
+			const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i *>(r.data() + i));
+			if (_mm_movemask_epi8(_mm_cmpeq_epi16(left, right)) == 0xFFFF)
+			{
+				continue;
+			}
+			else if (IsAsciiBlock(_mm_or_si128(left, right)))
+			{
+				if (_mm_movemask_epi8(_mm_cmpeq_epi16(ToLowerAsciiBlock(left), ToLowerAsciiBlock(right))) != 0xFFFF)
+				{
+					return false;
+				}
+			}
+			else if (!std::equal(l.data() + i, l.data() + i + BLOCK_SIZE, r.data() + i, [](const wchar_t &a, const wchar_t &b) { return ToLower(a) == ToLower(b); }))
+			{
+				return false;
+			}
+		}
+#endif
+		return std::equal(l.begin() + i, l.end(), r.begin() + i, [](const wchar_t &a, const wchar_t &b) -> bool
 		{
-			return b != L'\0' && std::towlower(a) == std::towlower(b);
+			return ToLower(a) == ToLower(b);
 		});
 	}
 
-	inline static bool IgnoreCaseStringEquals(const std::wstring &l, const std::wstring &r)
+	// Widens the ASCII characters at the beginning of a narrow string. Returns how many characters were converted.
+	inline static size_t WidenAscii(const char *data, const size_t &length, wchar_t *result)
 	{
-		return std::equal(l.begin(), l.end(), r.begin(), r.end(), [](const wchar_t &a, const wchar_t &b) -> bool
+		size_t i = 0;
+#ifdef UTIL_SSE2
+		for (; i + sizeof(__m128i) <= length; i += sizeof(__m128i))
 		{
-			return std::towlower(a) == std::towlower(b);
-		});
+			const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+			if (_mm_movemask_epi8(block) != 0)
+			{
+				// Leave the block to the scalar loop so it stops at the exact non-ASCII character.
+				break;
+			}
+
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(result + i), _mm_unpacklo_epi8(block, _mm_setzero_si128()));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(result + i + BLOCK_SIZE), _mm_unpackhi_epi8(block, _mm_setzero_si128()));
+		}
+#endif
+		for (; i < length && static_cast<unsigned char>(data[i]) < 0x80; i++)
+		{
+			result[i] = data[i];
+		}
+
+		return i;
+	}
+
+	// Computes the 64-bit FNV-1a hash of a block of memory.
+	inline static uint64_t HashBytes(const void *data, const size_t &size, uint64_t hash = 14695981039346656037ull)
+	{
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+
+		return hash;
+	}
+
+	// Hashes the lowercase variant of a string, without making a lowercase copy of it.
+	inline static uint64_t HashIgnoreCase(std::wstring_view data)
+	{
+		wchar_t buffer[64];
+		uint64_t hash = HashBytes(nullptr, 0);
+		for (size_t i = 0; i < data.length(); i += std::size(buffer))
+		{
+			const size_t length = (std::min)(std::size(buffer), data.length() - i);
+			std::copy_n(data.data() + i, length, buffer);
+			ToLowerInplace(buffer, length);
+			hash = HashBytes(buffer, length * sizeof(wchar_t), hash);
+		}
+
+		return hash;
 	}
 
 private:
 	struct string_hash {
 		inline std::size_t operator()(const std::wstring &k) const
 		{
-			static const std::hash<std::wstring> hasher;
-			return hasher(ToLower(k));
+			return static_cast<std::size_t>(HashIgnoreCase(k));
 		}
 	};
 
@@ -87,6 +231,20 @@ public:
 		return str.substr(first, (last - first + 1));
 	}
 
+	// Removes instances of a character at the beginning and end of the string.
+	inline static std::wstring_view Trim(std::wstring_view str, const wchar_t &character = L' ')
+	{
+		size_t first = str.find_first_not_of(character);
+
+		if (first == std::wstring_view::npos)
+		{
+			return { };
+		}
+
+		size_t last = str.find_last_not_of(character);
+		return str.substr(first, (last - first + 1));
+	}
+
 	// Removes instances of a character at the beginning and end of the string.
 	inline static void TrimInplace(std::wstring &str, const wchar_t &character = L' ')
 	{
@@ -122,6 +280,12 @@ public:
 		return true;
 	}
 
+	// Checks if a string ends with another string.
+	inline static bool StringEndsWith(std::wstring_view string, std::wstring_view text_to_test)
+	{
+		return string.length() >= text_to_test.length() && string.substr(string.length() - text_to_test.length()) == text_to_test;
+	}
+
 	// Removes a string at the beginning of another string.
 	inline static std::wstring RemovePrefix(const std::wstring &str, const std::wstring &prefix)
 	{
@@ -144,14 +308,46 @@ public:
 		}
 	}
 
-	// Changes a value. Use with std::bind and context menu callbacks (BindEnum preferred).
+	// Parses a whole string as an integer. Unlike std::stoi this never throws, and fails on trailing garbage.
+	template<typename T>
+	inline static bool ParseInteger(std::wstring_view str, T &result, const int &base = 10)
+	{
+		// Room for a sign and every digit in base 2.
+		char buffer[std::numeric_limits<T>::digits + 2];
+		if (str.empty() || str.length() > std::size(buffer))
+		{
+			return false;
+		}
+
+		for (size_t i = 0; i < str.length(); i++)
+		{
+			if (str[i] >= 0x80)
+			{
+				return false;
+			}
+
+			buffer[i] = static_cast<char>(str[i]);
+		}
+
+		T value;
+		const std::from_chars_result parsed = std::from_chars(buffer, buffer + str.length(), value, base);
+		if (parsed.ec != std::errc() || parsed.ptr != buffer + str.length())
+		{
+			return false;
+		}
+
+		result = value;
+		return true;
+	}
+
+	// Changes a value. Use with context menu callbacks (BindEnum preferred).
 	template<typename T>
 	inline static void UpdateValue(T &toupdate, const T &newvalue)
 	{
 		toupdate = newvalue;
 	}
 
-	// Inverts a boolean. Use with std::bind and context menu callbacks (BindBool preferred).
+	// Inverts a boolean. Use with context menu callbacks (BindBool preferred).
 	inline static void InvertBool(bool &value)
 	{
 		value = !value;
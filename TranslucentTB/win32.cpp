@@ -1,5 +1,7 @@
 #include "win32.hpp"
 #include "arch.h"
+#include <fileapi.h>
+#include <memory>
 #include <optional>
 #include <PathCch.h>
 #include <processthreadsapi.h>
@@ -26,19 +28,24 @@ const user32::pSetWindowCompositionAttribute user32::SetWindowCompositionAttribu
 
 std::wstring win32::m_ExeLocation;
 std::mutex win32::m_PickerThreadsLock;
-std::vector<DWORD> win32::m_PickerThreads;
+std::vector<std::pair<DWORD, const uint32_t *>> win32::m_PickerThreads;
 
 DWORD win32::PickerThreadProc(LPVOID data)
 {
-	const HRESULT hr = CColourPicker(*reinterpret_cast<uint32_t *>(data)).CreateColourPicker();
+	const std::unique_ptr<PICKER_DATA> picker_data(static_cast<PICKER_DATA *>(data));
+	const HRESULT hr = CColourPicker(picker_data->color, NULL, [](uint32_t value, void *context)
+	{
+		(*static_cast<const SmallFunction<void(uint32_t)> *>(context))(value);
+	}, &picker_data->callback).CreateColourPicker();
+
 	const DWORD tid = GetCurrentThreadId();
 	{
 		std::lock_guard guard(m_PickerThreadsLock);
-		for (DWORD &i_tid : m_PickerThreads)
+		for (auto &thread : m_PickerThreads)
 		{
-			if (i_tid == tid)
+			if (thread.first == tid)
 			{
-				std::swap(i_tid, m_PickerThreads.back());
+				std::swap(thread, m_PickerThreads.back());
 				m_PickerThreads.pop_back();
 				break;
 			}
@@ -52,23 +59,23 @@ DWORD win32::PickerThreadProc(LPVOID data)
 	return 0;
 }
 
-BOOL win32::EnumThreadWindowsProc(HWND hwnd, LPARAM lParam)
+BOOL win32::PickerWindowsProc(HWND hwnd, LPARAM lParam)
 {
-	Window wnd(hwnd);
-	bool &needs_wait = *reinterpret_cast<bool *>(lParam);
+	const Window wnd(hwnd);
 
 	if (*wnd.title() == L"Color Picker")
 	{
-		// 1068 == IDB_CANCEL
-		wnd.send_message(WM_COMMAND, MAKEWPARAM(1068, BN_CLICKED));
-
-		needs_wait = true;
-		return false;
+		return (*reinterpret_cast<const FunctionRef<bool(const Window &)> *>(lParam))(wnd);
 	}
 
 	return true;
 }
 
+void win32::ForEachPickerWindow(const DWORD &thread, FunctionRef<bool(const Window &)> callback)
+{
+	EnumThreadWindows(thread, PickerWindowsProc, reinterpret_cast<LPARAM>(&callback));
+}
+
 const std::wstring &win32::GetExeLocation()
 {
 	if (m_ExeLocation.empty())
@@ -181,6 +188,48 @@ bool win32::FileExists(const std::wstring &file)
 	}
 }
 
+bool win32::WriteFileAtomically(const std::wstring &file, const void *data, const size_t &size)
+{
+	const std::wstring temp = file + L".tmp";
+	{
+		winrt::file_handle handle(CreateFile(temp.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_ATTRIBUTE_NOT_CONTENT_INDEXED, NULL));
+		if (!handle)
+		{
+			return false;
+		}
+
+		DWORD bytesWritten = 0;
+		bool written = WriteFile(handle.get(), data, static_cast<DWORD>(size), &bytesWritten, NULL);
+		if (written && bytesWritten != size)
+		{
+			// A short write would replace the file with a truncated copy.
+			SetLastError(ERROR_WRITE_FAULT);
+			written = false;
+		}
+
+		if (!written || !FlushFileBuffers(handle.get()))
+		{
+			const DWORD error = GetLastError();
+
+			// The file isn't shared, it has to be closed before it can be deleted.
+			handle.close();
+			DeleteFile(temp.c_str());
+			SetLastError(error);
+			return false;
+		}
+	}
+
+	if (!MoveFileEx(temp.c_str(), file.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		const DWORD error = GetLastError();
+		DeleteFile(temp.c_str());
+		SetLastError(error);
+		return false;
+	}
+
+	return true;
+}
+
 void win32::CopyToClipboard(const std::wstring &text)
 {
 	ClipboardContext context;
@@ -282,16 +331,41 @@ void win32::OpenLink(const std::wstring &link)
 	}
 }
 
-DWORD win32::PickColor(uint32_t &color)
+DWORD win32::PickColor(const uint32_t &color, SmallFunction<void(uint32_t)> callback)
 {
-	DWORD threadId;
-	const winrt::handle hThread = CreateThread(nullptr, 0, PickerThreadProc, &color, CREATE_SUSPENDED, &threadId);
+	DWORD threadId = 0;
+	{
+		std::lock_guard guard(m_PickerThreadsLock);
+		for (const auto &[tid, target] : m_PickerThreads)
+		{
+			if (target == &color)
+			{
+				threadId = tid;
+				break;
+			}
+		}
+	}
+
+	if (threadId)
+	{
+		// There's already a picker for this color, bring it up instead.
+		// Don't hold the lock here, looking at the window titles waits on the picker thread.
+		ForEachPickerWindow(threadId, [](const Window &picker)
+		{
+			SetForegroundWindow(picker);
+			return false;
+		});
+		return threadId;
+	}
+
+	PICKER_DATA *data = new PICKER_DATA { color, std::move(callback) };
+	const winrt::handle hThread = CreateThread(nullptr, 0, PickerThreadProc, data, CREATE_SUSPENDED, &threadId);
 
 	if (hThread)
 	{
 		{
 			std::lock_guard guard(m_PickerThreadsLock);
-			m_PickerThreads.emplace_back(threadId);
+			m_PickerThreads.emplace_back(threadId, &color);
 		}
 
 		ResumeThread(hThread.get());
@@ -300,6 +374,7 @@ DWORD win32::PickColor(uint32_t &color)
 	else
 	{
 		LastErrorHandle(Error::Level::Error, L"Failed to spawn color picker thread!");
+		delete data;
 		return 0;
 	}
 }
@@ -309,10 +384,17 @@ void win32::ClosePickers()
 	std::unique_lock guard(m_PickerThreadsLock);
 	while (m_PickerThreads.size() != 0)
 	{
-		const DWORD tid = *m_PickerThreads.begin();
+		const DWORD tid = m_PickerThreads.begin()->first;
 		bool needs_wait = false;
 		guard.unlock();
-		EnumThreadWindows(tid, EnumThreadWindowsProc, reinterpret_cast<LPARAM>(&needs_wait));
+		ForEachPickerWindow(tid, [&needs_wait](const Window &picker)
+		{
+			// 1068 == IDB_CANCEL
+			picker.send_message(WM_COMMAND, MAKEWPARAM(1068, BN_CLICKED));
+
+			needs_wait = true;
+			return false;
+		});
 
 		if (needs_wait)
 		{
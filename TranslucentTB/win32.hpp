@@ -7,8 +7,12 @@
 #include <vector>
 #include <windef.h>
 
+#include "functionref.hpp"
+#include "smallfunction.hpp"
 #include "swcadata.hpp"
 
+class Window; // Forward declare to avoid circular deps
+
 class user32 {
 
 private:
@@ -24,10 +28,18 @@ class win32 {
 private:
 	static std::wstring m_ExeLocation;
 	static std::mutex m_PickerThreadsLock;
-	static std::vector<DWORD> m_PickerThreads;
+	static std::vector<std::pair<DWORD, const uint32_t *>> m_PickerThreads;
+
+	struct PICKER_DATA {
+		uint32_t color;
+		SmallFunction<void(uint32_t)> callback;
+	};
 
 	static DWORD WINAPI PickerThreadProc(LPVOID data);
-	static BOOL CALLBACK EnumThreadWindowsProc(HWND hwnd, LPARAM lParam);
+	static BOOL CALLBACK PickerWindowsProc(HWND hwnd, LPARAM lParam);
+
+	// Calls back with the color picker windows of a thread, until the callback returns false.
+	static void ForEachPickerWindow(const DWORD &thread, FunctionRef<bool(const Window &)> callback);
 
 public:
 	// Gets location of current module, fatally dies if failed.
@@ -45,6 +57,10 @@ public:
 	// Checks if a file exists.
 	static bool FileExists(const std::wstring &file);
 
+	// Writes a file through a temporary file, so that readers and crashes see either the old or the new content.
+	// Check the last error if it fails.
+	static bool WriteFileAtomically(const std::wstring &file, const void *data, const size_t &size);
+
 	// Copies text to the clipboard.
 	static void CopyToClipboard(const std::wstring &text);
 
@@ -55,10 +71,11 @@ public:
 	// NOTE: doesn't attempts to validate the link, make sure it's correct.
 	static void OpenLink(const std::wstring &link);
 
-	// Opens a color picker.
+	// Opens a color picker. The picker edits a copy of the color, and calls back with
+	// every new value from its own thread. Only one picker is opened per color.
 	// NOTE: the function returns the thread ID, use it with OpenThread and
 	// WaitForSingleObject if you want to block for input.
-	static DWORD PickColor(uint32_t &color);
+	static DWORD PickColor(const uint32_t &color, SmallFunction<void(uint32_t)> callback);
 
 	// Cancels all active color pickers.
 	static void ClosePickers();
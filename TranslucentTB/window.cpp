@@ -7,6 +7,8 @@
 #include "createinstance.hpp"
 #include "common.hpp"
 #include "eventhook.hpp"
+#include "metrics.hpp"
+#include "tracing.hpp"
 #include "ttberror.hpp"
 
 std::mutex Window::m_ClassNamesLock;
@@ -28,6 +30,8 @@ std::shared_ptr<const std::wstring> Window::title() const
 
 	if (m_Titles.count(m_WindowHandle) == 0)
 	{
+		TraceScope("Window::title");
+		Metrics::Increment(Metrics::Counter::TitleCacheMisses);
 		std::shared_ptr<std::wstring> windowTitle = std::make_shared<std::wstring>();
 		int titleSize = GetWindowTextLength(m_WindowHandle) + 1; // For the null terminator
 		windowTitle->resize(titleSize);
@@ -45,6 +49,7 @@ std::shared_ptr<const std::wstring> Window::title() const
 	}
 	else
 	{
+		Metrics::Increment(Metrics::Counter::TitleCacheHits);
 		return m_Titles.at(m_WindowHandle);
 	}
 }
@@ -55,6 +60,8 @@ std::shared_ptr<const std::wstring> Window::classname() const
 
 	if (m_ClassNames.count(m_WindowHandle) == 0)
 	{
+		TraceScope("Window::classname");
+		Metrics::Increment(Metrics::Counter::ClassNameCacheMisses);
 		std::shared_ptr<std::wstring> className = std::make_shared<std::wstring>();
 		className->resize(257);	// According to docs, maximum length of a class name is 256, but it's ambiguous
 								// wether this includes the null terminator or not.
@@ -74,6 +81,7 @@ std::shared_ptr<const std::wstring> Window::classname() const
 	}
 	else
 	{
+		Metrics::Increment(Metrics::Counter::ClassNameCacheHits);
 		return m_ClassNames.at(m_WindowHandle);
 	}
 }
@@ -84,6 +92,8 @@ std::shared_ptr<const std::wstring> Window::filename() const
 
 	if (m_Filenames.count(m_WindowHandle) == 0)
 	{
+		TraceScope("Window::filename");
+		Metrics::Increment(Metrics::Counter::FileNameCacheMisses);
 		DWORD pid;
 		GetWindowThreadProcessId(m_WindowHandle, &pid);
 		std::shared_ptr<std::wstring> exeName = std::make_shared<std::wstring>();
@@ -111,6 +121,7 @@ std::shared_ptr<const std::wstring> Window::filename() const
 	}
 	else
 	{
+		Metrics::Increment(Metrics::Counter::FileNameCacheHits);
 		return m_Filenames.at(m_WindowHandle);
 	}
 }
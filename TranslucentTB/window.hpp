@@ -67,13 +67,14 @@ public:
 		return CreateWindowEx(dwExStyle, className.c_str(), windowName.c_str(), dwStyle, x, y, nWidth, nHeight,
 			parent, hMenu, hInstance, lpParam);
 	}
+	// The creation parameter is taken by the window class, see WindowClass.
 	inline static Window Create(const unsigned long &dwExStyle, const WindowClass &winClass,
 		const std::wstring &windowName, const unsigned long &dwStyle, const int &x = 0,
 		const int &y = 0, const int &nWidth = 0, const int &nHeight = 0, const Window &parent = Window::NullWindow,
-		const HMENU &hMenu = NULL, const HINSTANCE &hInstance = GetModuleHandle(NULL), void *lpParam = nullptr)
+		const HMENU &hMenu = NULL, const HINSTANCE &hInstance = GetModuleHandle(NULL))
 	{
 		return CreateWindowEx(dwExStyle, winClass.atom(), windowName.c_str(), dwStyle, x, y, nWidth, nHeight,
-			parent, hMenu, hInstance, lpParam);
+			parent, hMenu, hInstance, const_cast<WindowClass *>(&winClass));
 	}
 	inline static Window ForegroundWindow() noexcept
 	{
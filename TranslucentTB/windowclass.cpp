@@ -1,25 +1,32 @@
 #include "windowclass.hpp"
 #include <CommCtrl.h>
+#include <utility>
 #include <WinBase.h>
 #include <winerror.h>
 
 #include "ttberror.hpp"
 #include "window.hpp"
 
-std::unordered_map<ATOM, WindowClass::callback_t> WindowClass::m_CallbackMap;
-
 LRESULT WindowClass::RawWindowProcedure(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
-	ATOM atom = static_cast<ATOM>(GetClassLongPtr(hwnd, GCW_ATOM));
-	if (!atom)
+	if (msg == WM_NCCREATE)
 	{
-		LastErrorHandle(Error::Level::Fatal, L"Failed to get class atom!");
+		const CREATESTRUCT &create = *reinterpret_cast<const CREATESTRUCT *>(lParam);
+		SetWindowLongPtr(hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(create.lpCreateParams));
 	}
 
-	return m_CallbackMap[atom](hwnd, msg, wParam, lParam);
+	if (const auto winClass = reinterpret_cast<const WindowClass *>(GetWindowLongPtr(hwnd, GWLP_USERDATA)))
+	{
+		return winClass->m_Callback(hwnd, msg, wParam, lParam);
+	}
+	else
+	{
+		// Some messages, like WM_GETMINMAXINFO, come before WM_NCCREATE.
+		return DefWindowProc(hwnd, msg, wParam, lParam);
+	}
 }
 
-WindowClass::WindowClass(const callback_t &callback, const std::wstring &className, const wchar_t *iconResource, const unsigned int &style, const HINSTANCE &hInstance, const HBRUSH &brush, const HCURSOR &cursor) :
+WindowClass::WindowClass(callback_t callback, const std::wstring &className, const wchar_t *iconResource, const unsigned int &style, const HINSTANCE &hInstance, const HBRUSH &brush, const HCURSOR &cursor) :
 	m_ClassStruct {
 		sizeof(m_ClassStruct),
 		style,
@@ -33,17 +40,14 @@ WindowClass::WindowClass(const callback_t &callback, const std::wstring &classNa
 		nullptr,
 		className.c_str(),
 		nullptr
-	}
+	},
+	m_Callback(std::move(callback))
 {
 	ErrorHandle(LoadIconMetric(hInstance, iconResource, LIM_LARGE, &m_ClassStruct.hIcon), Error::Level::Log, L"Failed to load large window class icon.");
 	ErrorHandle(LoadIconMetric(hInstance, iconResource, LIM_SMALL, &m_ClassStruct.hIconSm), Error::Level::Log, L"Failed to load small window class icon.");
 
 	m_Atom = RegisterClassEx(&m_ClassStruct);
-	if (m_Atom)
-	{
-		m_CallbackMap.emplace(m_Atom, callback);
-	}
-	else
+	if (!m_Atom)
 	{
 		LastErrorHandle(Error::Level::Fatal, L"Failed to register window class!");
 	}
@@ -51,7 +55,6 @@ WindowClass::WindowClass(const callback_t &callback, const std::wstring &classNa
 
 WindowClass::~WindowClass()
 {
-	m_CallbackMap.erase(m_Atom);
 	if (!UnregisterClass(atom(), m_ClassStruct.hInstance))
 	{
 		LastErrorHandle(Error::Level::Log, L"Failed to unregister window class.");